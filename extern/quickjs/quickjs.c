@@ -17577,16 +17577,21 @@ static JSValue JS_CallInternal(JSContext *caller_ctx, JSValueConst func_obj,
             BREAK;
 
         CASE(OP_goto):
+            /* quickjs-tools: branches poll for interrupts, so record the position an interrupt handler or
+               backtrace reports here as it does for calls */
+            sf->cur_pc = pc;
             pc += (int32_t)get_u32(pc);
             if (unlikely(js_poll_interrupts(ctx)))
                 goto exception;
             BREAK;
         CASE(OP_goto16):
+            sf->cur_pc = pc;
             pc += (int16_t)get_u16(pc);
             if (unlikely(js_poll_interrupts(ctx)))
                 goto exception;
             BREAK;
         CASE(OP_goto8):
+            sf->cur_pc = pc;
             pc += (int8_t)pc[0];
             if (unlikely(js_poll_interrupts(ctx)))
                 goto exception;
@@ -17596,6 +17601,7 @@ static JSValue JS_CallInternal(JSContext *caller_ctx, JSValueConst func_obj,
                 int res;
                 JSValue op1;
 
+                sf->cur_pc = pc;
                 op1 = sp[-1];
                 pc += 4;
                 if ((uint32_t)JS_VALUE_GET_TAG(op1) <= JS_TAG_UNDEFINED) {
@@ -17616,6 +17622,7 @@ static JSValue JS_CallInternal(JSContext *caller_ctx, JSValueConst func_obj,
                 int res;
                 JSValue op1;
 
+                sf->cur_pc = pc;
                 op1 = sp[-1];
                 pc += 4;
                 if ((uint32_t)JS_VALUE_GET_TAG(op1) <= JS_TAG_UNDEFINED) {
@@ -17636,6 +17643,7 @@ static JSValue JS_CallInternal(JSContext *caller_ctx, JSValueConst func_obj,
                 int res;
                 JSValue op1;
 
+                sf->cur_pc = pc;
                 op1 = sp[-1];
                 pc += 1;
                 if ((uint32_t)JS_VALUE_GET_TAG(op1) <= JS_TAG_UNDEFINED) {
@@ -17656,6 +17664,7 @@ static JSValue JS_CallInternal(JSContext *caller_ctx, JSValueConst func_obj,
                 int res;
                 JSValue op1;
 
+                sf->cur_pc = pc;
                 op1 = sp[-1];
                 pc += 1;
                 if ((uint32_t)JS_VALUE_GET_TAG(op1) <= JS_TAG_UNDEFINED) {
@@ -28999,6 +29008,32 @@ JSAtom JS_GetScriptOrModuleName(JSContext *ctx, int n_stack_levels)
     return JS_DupAtom(ctx, b->filename);
 }
 
+/* quickjs-tools */
+bool JS_GetCurrentFrame(JSContext *ctx, JSValueConst *func,
+                        const void **function_bytecode, int *pc)
+{
+    JSStackFrame *sf;
+    JSFunctionBytecode *b;
+    JSObject *p;
+
+    sf = ctx->rt->current_stack_frame;
+    if (!sf)
+        return false;
+    *func = sf->cur_func;
+    *function_bytecode = NULL;
+    *pc = -1;
+    if (JS_VALUE_GET_TAG(sf->cur_func) != JS_TAG_OBJECT)
+        return true;
+    p = JS_VALUE_GET_OBJ(sf->cur_func);
+    if (!js_class_has_bytecode(p->class_id))
+        return true;
+    b = p->u.func.function_bytecode;
+    *function_bytecode = b;
+    if (sf->cur_pc)
+        *pc = sf->cur_pc - b->byte_code_buf - 1;
+    return true;
+}
+
 JSAtom JS_GetModuleName(JSContext *ctx, JSModuleDef *m)
 {
     return JS_DupAtom(ctx, m->module_name);
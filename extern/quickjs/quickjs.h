@@ -1104,6 +1104,12 @@ JS_EXTERN int JS_ResolveModule(JSContext *ctx, JSValueConst obj);
 
 /* only exported for os.Worker() */
 JS_EXTERN JSAtom JS_GetScriptOrModuleName(JSContext *ctx, int n_stack_levels);
+/* quickjs-tools: function of the innermost stack frame, not duplicated. For bytecode functions,
+   'function_bytecode' is set to its JSFunctionBytecode and 'pc' to the offset of the instruction it
+   last called, threw or branched from, or -1 if there is none yet; otherwise they are NULL and -1.
+   Returns false if no function is running. */
+JS_EXTERN bool JS_GetCurrentFrame(JSContext *ctx, JSValueConst *func,
+                                  const void **function_bytecode, int *pc);
 /* only exported for os.Worker() */
 JS_EXTERN JSValue JS_LoadModule(JSContext *ctx, const char *basename,
                                 const char *filename);
@@ -0,0 +1,85 @@
+#include "bytecode_lint.h"
+
+#include "instruction_decoder.h"
+
+// special_object operands, from OP_SPECIAL_OBJECT_* in quickjs.c
+constexpr int64_t special_object_arguments = 0;
+constexpr int64_t special_object_mapped_arguments = 1;
+
+// Rule the instruction breaks at the given loop depth, or lint_rule::count if it breaks none
+static lint_rule rule_for(const decoded_instruction & insn, const int loop_depth) {
+    const bool in_loop = loop_depth > 0;
+
+    switch (insn.info->id) {
+        case op_get_var:
+        case op_get_var_undef:
+        case op_put_var:
+        case op_put_var_strict:
+            return in_loop ? lint_rule::global_in_loop : lint_rule::count;
+        case op_with_get_var:
+        case op_with_put_var:
+        case op_with_delete_var:
+        case op_with_make_ref:
+        case op_with_get_ref:
+        case op_with_get_ref_undef:
+            // The last operand is 0 when the object is the variable object of a direct eval instead of a with
+            return insn.operands[insn.operand_count - 1].value != 0 ? lint_rule::with_scope : lint_rule::direct_eval;
+        case op_eval:
+        case op_apply_eval:
+            return lint_rule::direct_eval;
+        case op_special_object: {
+            const int64_t type = insn.operands[0].value;
+            return type == special_object_arguments || type == special_object_mapped_arguments
+                ? lint_rule::arguments_object
+                : lint_rule::count;
+        }
+        case op_fclosure:
+        case op_fclosure8:
+            return in_loop ? lint_rule::closure_in_loop : lint_rule::count;
+        case op_get_var_ref:
+        case op_put_var_ref:
+        case op_set_var_ref:
+        case op_get_var_ref0:
+        case op_get_var_ref1:
+        case op_get_var_ref2:
+        case op_get_var_ref3:
+        case op_put_var_ref0:
+        case op_put_var_ref1:
+        case op_put_var_ref2:
+        case op_put_var_ref3:
+        case op_set_var_ref0:
+        case op_set_var_ref1:
+        case op_set_var_ref2:
+        case op_set_var_ref3:
+        case op_get_var_ref_check:
+        case op_put_var_ref_check:
+        case op_put_var_ref_check_init:
+        case op_close_loc:
+            return in_loop ? lint_rule::captured_in_loop : lint_rule::count;
+        default:
+            return lint_rule::count;
+    }
+}
+
+std::vector<lint_finding> lint_function(const JSFunctionBytecode * b, const control_flow_graph & cfg) {
+    std::vector<lint_finding> findings;
+
+    for (uint32_t i = 0; i < cfg.blocks.size(); i++) {
+        const basic_block & block = cfg.blocks[i];
+        if (!block.reachable) continue;
+
+        const int depth = cfg.loop_depth(i);
+
+        for (uint32_t pos = block.start; pos < block.end;) {
+            const decoded_instruction insn = decode_instruction(b, pos);
+            const lint_rule rule = rule_for(insn, depth);
+
+            if (rule != lint_rule::count) {
+                findings.push_back({rule, pos, depth});
+            }
+            pos += insn.info->size;
+        }
+    }
+
+    return findings;
+}
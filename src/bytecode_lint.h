@@ -0,0 +1,51 @@
+#ifndef BYTECODE_LINT_H
+#define BYTECODE_LINT_H
+#include <array>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "control_flow.h"
+#include "quickjs_bytecode.h"
+
+enum class lint_rule : uint8_t {
+    // get_var and put_var look the name up in the global object on every iteration
+    global_in_loop,
+    // with_* opcodes look every name up in the with object first, and keep the scope from being optimized
+    with_scope,
+    // Direct eval keeps every variable of the enclosing scopes alive, and makes the names it may declare
+    // be looked up in its variable object first
+    direct_eval,
+    // Creating the arguments object copies the arguments, and the mapped one aliases them to the locals
+    arguments_object,
+    // fclosure allocates a new function object on every iteration
+    closure_in_loop,
+    // Captured variables are read and written through a JSVarRef, and close_loc in a loop detaches a fresh
+    // one on every iteration
+    captured_in_loop,
+    count,
+};
+
+constexpr std::array<std::string_view, static_cast<size_t>(lint_rule::count)> lint_rule_names{
+    "global-in-loop",
+    "with",
+    "eval",
+    "arguments",
+    "closure-in-loop",
+    "captured-variable-in-loop",
+};
+
+struct lint_finding {
+    lint_rule rule;
+    uint32_t pos;
+    // Number of loops the instruction is in
+    int loop_depth;
+};
+
+// Finds the instructions of the function matching a known slow pattern, in offset order.
+// Unreachable instructions are skipped.
+std::vector<lint_finding> lint_function(const JSFunctionBytecode * b, const control_flow_graph & cfg);
+
+using lint_counts = std::array<uint64_t, static_cast<size_t>(lint_rule::count)>;
+
+#endif //BYTECODE_LINT_H
@@ -0,0 +1,104 @@
+#include "content_cache.h"
+#include <array>
+#include <atomic>
+#include <cstdio>
+#include <format>
+#include <functional>
+#include <thread>
+#include <utility>
+
+#include <unistd.h>
+
+// Leads every entry, so truncated files and files which are not entries are never taken for one
+struct entry_header {
+    std::array<char, 8> magic;
+    uint64_t key;
+    uint64_t payload_size;
+};
+
+constexpr std::array<char, 8> entry_magic{'Q', 'J', 'T', 'C', 'A', 'C', 'H', '1'};
+
+content_hash & content_hash::add(const void * data, const size_t size) {
+    const auto * bytes = static_cast<const uint8_t *>(data);
+    for (size_t i = 0; i < size; i++) {
+        state = (state ^ bytes[i]) * 1099511628211ULL;
+    }
+    return *this;
+}
+
+content_hash & content_hash::add(const std::string_view bytes) {
+    add_value(static_cast<uint64_t>(bytes.size()));
+    return add(bytes.data(), bytes.size());
+}
+
+content_cache::content_cache(std::filesystem::path directory) : directory(std::move(directory)) {}
+
+std::filesystem::path content_cache::path_for(const uint64_t key, const std::string_view kind) const {
+    // Entries are spread over 256 subdirectories to keep directories small on large trees
+    return directory / std::format("{:02x}", key >> 56) / std::format("{:016x}.{}", key, kind);
+}
+
+bool content_cache::load(const uint64_t key, const std::string_view kind, mapped_file & file,
+                         std::string_view & payload) const {
+    std::string error;
+    if (!file.open(path_for(key, kind).string(), error)) {
+        return false;
+    }
+
+    entry_header header{};
+    if (file.size() < sizeof(header)) {
+        return false;
+    }
+
+    std::memcpy(&header, file.data(), sizeof(header));
+    if (header.magic != entry_magic || header.key != key || header.payload_size != file.size() - sizeof(header)) {
+        return false;
+    }
+
+    payload = file.text().substr(sizeof(header));
+    return true;
+}
+
+bool content_cache::store(const uint64_t key, const std::string_view kind, const std::string_view payload) const {
+    static std::atomic<uint64_t> next_temporary{0};
+
+    const std::filesystem::path path = path_for(key, kind);
+    std::error_code error;
+    std::filesystem::create_directories(path.parent_path(), error);
+
+    // Unique among the processes and threads that may be writing the same entry at once
+    std::filesystem::path temporary = path;
+    temporary += std::format(".{}.{}.{}.tmp", getpid(), std::hash<std::thread::id>{}(std::this_thread::get_id()),
+                             next_temporary++);
+
+    FILE * file = fopen(temporary.string().c_str(), "wb");
+    if (file == nullptr) return false;
+
+    const entry_header header{entry_magic, key, payload.size()};
+    bool success = fwrite(&header, sizeof(header), 1, file) == 1
+        && fwrite(payload.data(), 1, payload.size(), file) == payload.size();
+    success = fclose(file) == 0 && success;
+
+    if (success) {
+        std::filesystem::rename(temporary, path, error);
+        success = !error;
+    }
+
+    if (!success) {
+        std::filesystem::remove(temporary, error);
+    }
+    return success;
+}
+
+void record_writer::put_string(const std::string_view text) {
+    put(static_cast<uint64_t>(text.size()));
+    data.append(text);
+}
+
+bool record_reader::get_string(std::string & text) {
+    uint64_t size;
+    if (!get(size) || data.size() - pos < size) return fail();
+    text.assign(data.substr(pos, size));
+    pos += size;
+    return true;
+}
@@ -0,0 +1,115 @@
+#ifndef CONTENT_CACHE_H
+#define CONTENT_CACHE_H
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+#include "mapped_file.h"
+
+// 64-bit FNV-1a hash, fed one piece of the key at a time
+class content_hash {
+public:
+    content_hash & add(const void * data, size_t size);
+
+    // Adds the length before the bytes, so consecutive strings can't run into each other
+    content_hash & add(std::string_view bytes);
+
+    template <typename T>
+        requires std::is_trivially_copyable_v<T>
+    content_hash & add_value(const T & value) {
+        return add(&value, sizeof(value));
+    }
+
+    uint64_t value() const { return state; }
+
+private:
+    uint64_t state = 14695981039346656037ULL;
+};
+
+// Directory of entries named by a key and a kind. Entries are written once, to a temporary file renamed into
+// place, so concurrent runs sharing the directory never see a partial entry, and read back by mapping them.
+// The cache is best effort: failing to read or write an entry only means the work is done again.
+class content_cache {
+public:
+    explicit content_cache(std::filesystem::path directory);
+
+    // Maps the entry and points payload at its contents. Returns false if there is no valid entry.
+    bool load(uint64_t key, std::string_view kind, mapped_file & file, std::string_view & payload) const;
+
+    bool store(uint64_t key, std::string_view kind, std::string_view payload) const;
+
+private:
+    std::filesystem::path path_for(uint64_t key, std::string_view kind) const;
+
+    std::filesystem::path directory;
+};
+
+// Numbers and enums, the only values written as raw bytes. Structs are written field by field, so their padding
+// and layout never reach an entry.
+template <typename T>
+concept record_scalar = std::is_arithmetic_v<T> || std::is_enum_v<T>;
+
+// Builds an entry's payload out of scalars, arrays of them and length-prefixed strings
+class record_writer {
+public:
+    template <record_scalar T>
+    void put(const T & value) {
+        data.append(reinterpret_cast<const char *>(&value), sizeof(value));
+    }
+
+    template <record_scalar T, size_t N>
+    void put(const std::array<T, N> & values) {
+        for (const T & value : values) put(value);
+    }
+
+    void put_string(std::string_view text);
+
+    std::string take() { return std::move(data); }
+
+private:
+    std::string data;
+};
+
+// Reads back what a record_writer wrote. Reading past the end fails the reader instead of the read.
+class record_reader {
+public:
+    explicit record_reader(const std::string_view data) : data(data) {}
+
+    template <record_scalar T>
+    bool get(T & value) {
+        if (failed || data.size() - pos < sizeof(value)) return fail();
+        std::memcpy(&value, data.data() + pos, sizeof(value));
+        pos += sizeof(value);
+        return true;
+    }
+
+    template <record_scalar T, size_t N>
+    bool get(std::array<T, N> & values) {
+        for (T & value : values) {
+            if (!get(value)) return false;
+        }
+        return true;
+    }
+
+    bool get_string(std::string & text);
+
+    // Whether everything was read without running past the end
+    bool finished() const { return !failed && pos == data.size(); }
+
+private:
+    bool fail() {
+        failed = true;
+        return false;
+    }
+
+    std::string_view data;
+    size_t pos = 0;
+    bool failed = false;
+};
+
+#endif //CONTENT_CACHE_H
@@ -0,0 +1,257 @@
+#include "control_flow.h"
+#include <algorithm>
+#include <map>
+
+#include "instruction_decoder.h"
+
+bool is_terminator(const opcode op) {
+    switch (op) {
+        case op_return:
+        case op_return_undef:
+        case op_return_async:
+        case op_throw:
+        case op_throw_error:
+        case op_tail_call:
+        case op_tail_call_method:
+        case op_ret:
+        case op_goto:
+        case op_goto8:
+        case op_goto16:
+            return true;
+        default:
+            return false;
+    }
+}
+
+bool is_unconditional_jump(const opcode op) {
+    return op == op_goto || op == op_goto8 || op == op_goto16;
+}
+
+uint32_t control_flow_graph::block_at(const uint32_t pos) const {
+    const auto it = std::upper_bound(blocks.begin(), blocks.end(), pos, [](const uint32_t value, const basic_block & block) {
+        return value < block.start;
+    });
+    return it == blocks.begin() ? NO_BLOCK : static_cast<uint32_t>(it - blocks.begin() - 1);
+}
+
+bool control_flow_graph::dominates(const uint32_t dominator, uint32_t block) const {
+    if (!blocks[block].reachable) return false;
+
+    for (; block != NO_BLOCK; block = blocks[block].idom) {
+        if (block == dominator) return true;
+    }
+    return false;
+}
+
+int control_flow_graph::loop_depth(const uint32_t block) const {
+    const uint32_t loop = blocks[block].loop;
+    return loop == NO_LOOP ? 0 : loops[loop].depth;
+}
+
+bool control_flow_graph::is_back_edge(const uint32_t from, const uint32_t to) const {
+    return dominates(to, from);
+}
+
+// Splits the bytecode into blocks at jump targets and after branches and terminators
+static void find_blocks(const JSFunctionBytecode * b, control_flow_graph & cfg) {
+    const uint32_t length = b->byte_code_len;
+    std::vector<bool> leaders(length + 1, false);
+    leaders[0] = true;
+
+    for (uint32_t pos = 0; pos < length; pos += get_instruction(b->byte_code_buf[pos]).size) {
+        const decoded_instruction insn = decode_instruction(b, pos);
+        const int64_t target = label_target(insn);
+
+        if (target >= 0 && target < length) {
+            leaders[target] = true;
+        }
+
+        if (target >= 0 || is_terminator(insn.info->id)) {
+            leaders[std::min<uint32_t>(pos + insn.info->size, length)] = true;
+        }
+    }
+
+    for (uint32_t pos = 0; pos < length;) {
+        basic_block block{
+            .start = pos,
+            .end = pos,
+            .last = pos,
+            .instruction_count = 0,
+            .successors = {},
+            .predecessors = {},
+            .idom = NO_BLOCK,
+            .loop = NO_LOOP,
+            .reachable = false,
+        };
+
+        do {
+            block.last = pos;
+            block.instruction_count++;
+            pos += get_instruction(b->byte_code_buf[pos]).size;
+        } while (pos < length && !leaders[pos]);
+
+        block.end = std::min(pos, length);
+        cfg.blocks.push_back(std::move(block));
+    }
+}
+
+static void add_edge(control_flow_graph & cfg, const uint32_t from, const uint32_t to) {
+    auto & successors = cfg.blocks[from].successors;
+    if (std::find(successors.begin(), successors.end(), to) != successors.end()) return;
+
+    successors.push_back(to);
+    cfg.blocks[to].predecessors.push_back(from);
+}
+
+static void find_edges(const JSFunctionBytecode * b, control_flow_graph & cfg) {
+    const auto num_blocks = static_cast<uint32_t>(cfg.blocks.size());
+
+    for (uint32_t i = 0; i < num_blocks; i++) {
+        const decoded_instruction insn = decode_instruction(b, cfg.blocks[i].last);
+        const int64_t target = label_target(insn);
+
+        if (target >= 0 && target < b->byte_code_len) {
+            add_edge(cfg, i, cfg.block_at(static_cast<uint32_t>(target)));
+        }
+
+        if (!is_terminator(insn.info->id) && i + 1 < num_blocks) {
+            add_edge(cfg, i, i + 1);
+        }
+    }
+}
+
+// Iterative dominator computation from "A Simple, Fast Dominance Algorithm" (Cooper, Harvey and Kennedy)
+static void find_dominators(control_flow_graph & cfg) {
+    if (cfg.blocks.empty()) return;
+
+    // Reverse postorder of the blocks reachable from the entry
+    std::vector<uint32_t> postorder;
+    std::vector<uint32_t> order(cfg.blocks.size(), NO_BLOCK);
+    std::vector<std::pair<uint32_t, size_t>> stack{{0, 0}};
+    cfg.blocks[0].reachable = true;
+
+    while (!stack.empty()) {
+        auto & [block, next_successor] = stack.back();
+        const auto & successors = cfg.blocks[block].successors;
+
+        if (next_successor < successors.size()) {
+            const uint32_t successor = successors[next_successor++];
+            if (!cfg.blocks[successor].reachable) {
+                cfg.blocks[successor].reachable = true;
+                stack.emplace_back(successor, 0);
+            }
+        } else {
+            order[block] = static_cast<uint32_t>(postorder.size());
+            postorder.push_back(block);
+            stack.pop_back();
+        }
+    }
+
+    auto intersect = [&](uint32_t a, uint32_t b) {
+        while (a != b) {
+            while (order[a] < order[b]) a = cfg.blocks[a].idom;
+            while (order[b] < order[a]) b = cfg.blocks[b].idom;
+        }
+        return a;
+    };
+
+    // The entry is its own dominator while iterating
+    cfg.blocks[0].idom = 0;
+
+    for (bool changed = true; changed;) {
+        changed = false;
+
+        for (auto it = postorder.rbegin(); it != postorder.rend(); ++it) {
+            const uint32_t block = *it;
+            if (block == 0) continue;
+
+            uint32_t idom = NO_BLOCK;
+            for (const uint32_t predecessor : cfg.blocks[block].predecessors) {
+                if (cfg.blocks[predecessor].idom == NO_BLOCK) continue;
+                idom = idom == NO_BLOCK ? predecessor : intersect(predecessor, idom);
+            }
+
+            if (cfg.blocks[block].idom != idom) {
+                cfg.blocks[block].idom = idom;
+                changed = true;
+            }
+        }
+    }
+
+    cfg.blocks[0].idom = NO_BLOCK;
+}
+
+// Natural loops of the back edges, merged by header, and their nesting
+static void find_loops(control_flow_graph & cfg) {
+    std::map<uint32_t, natural_loop> by_header;
+
+    for (uint32_t latch = 0; latch < cfg.blocks.size(); latch++) {
+        for (const uint32_t header : cfg.blocks[latch].successors) {
+            if (!cfg.is_back_edge(latch, header)) continue;
+
+            natural_loop & loop = by_header[header];
+            loop.header = header;
+            loop.latches.push_back(latch);
+        }
+    }
+
+    for (auto & [header, loop] : by_header) {
+        std::vector<bool> in_loop(cfg.blocks.size(), false);
+        in_loop[header] = true;
+        std::vector<uint32_t> worklist;
+
+        for (const uint32_t latch : loop.latches) {
+            if (!in_loop[latch]) {
+                in_loop[latch] = true;
+                worklist.push_back(latch);
+            }
+        }
+
+        while (!worklist.empty()) {
+            const uint32_t block = worklist.back();
+            worklist.pop_back();
+
+            for (const uint32_t predecessor : cfg.blocks[block].predecessors) {
+                if (!in_loop[predecessor] && cfg.blocks[predecessor].reachable) {
+                    in_loop[predecessor] = true;
+                    worklist.push_back(predecessor);
+                }
+            }
+        }
+
+        for (uint32_t block = 0; block < cfg.blocks.size(); block++) {
+            if (in_loop[block]) loop.blocks.push_back(block);
+        }
+
+        cfg.loops.push_back(std::move(loop));
+    }
+
+    // Outer loops are larger than the loops nested in them, so visiting loops from the largest
+    // down leaves each block assigned to its innermost loop and gives parents their depth first
+    std::vector<uint32_t> by_size(cfg.loops.size());
+    for (uint32_t i = 0; i < by_size.size(); i++) by_size[i] = i;
+    std::stable_sort(by_size.begin(), by_size.end(), [&](const uint32_t a, const uint32_t b) {
+        return cfg.loops[a].blocks.size() > cfg.loops[b].blocks.size();
+    });
+
+    for (const uint32_t index : by_size) {
+        natural_loop & loop = cfg.loops[index];
+        loop.parent = cfg.blocks[loop.header].loop;
+        loop.depth = loop.parent == NO_LOOP ? 1 : cfg.loops[loop.parent].depth + 1;
+
+        for (const uint32_t block : loop.blocks) {
+            cfg.blocks[block].loop = index;
+        }
+    }
+}
+
+control_flow_graph build_control_flow_graph(const JSFunctionBytecode * b) {
+    control_flow_graph cfg;
+
+    find_blocks(b, cfg);
+    find_edges(b, cfg);
+    find_dominators(cfg);
+    find_loops(cfg);
+
+    return cfg;
+}
@@ -0,0 +1,68 @@
+#ifndef CONTROL_FLOW_H
+#define CONTROL_FLOW_H
+#include <cstdint>
+#include <vector>
+
+#include "opcodes.h"
+#include "quickjs_bytecode.h"
+
+constexpr uint32_t NO_BLOCK = UINT32_MAX;
+constexpr uint32_t NO_LOOP = UINT32_MAX;
+
+struct basic_block {
+    // Byte offsets of the block's instructions, end exclusive
+    uint32_t start;
+    uint32_t end;
+    // Offset of the block's last instruction
+    uint32_t last;
+    uint32_t instruction_count;
+
+    std::vector<uint32_t> successors;
+    std::vector<uint32_t> predecessors;
+
+    // Immediate dominator, NO_BLOCK for the entry block and unreachable blocks
+    uint32_t idom;
+    // Innermost loop containing the block, or NO_LOOP
+    uint32_t loop;
+    bool reachable;
+};
+
+struct natural_loop {
+    uint32_t header;
+    // Innermost enclosing loop, or NO_LOOP
+    uint32_t parent;
+    // 1 for a loop which is not nested in any other
+    int depth;
+    // Blocks of the loop body including the header, in offset order
+    std::vector<uint32_t> blocks;
+    // Blocks with a back edge to the header
+    std::vector<uint32_t> latches;
+};
+
+// Basic blocks of a function and the loops found from their dominator tree. Edges come from the
+// label operands of jumps, conditional branches, catch, gosub and with_* instructions; a catch
+// is treated as a branch to its handler, and ret has no successors.
+struct control_flow_graph {
+    std::vector<basic_block> blocks;
+    // Ordered by header offset
+    std::vector<natural_loop> loops;
+
+    // Block containing the instruction at pos
+    uint32_t block_at(uint32_t pos) const;
+
+    bool dominates(uint32_t dominator, uint32_t block) const;
+
+    // Number of loops containing the block
+    int loop_depth(uint32_t block) const;
+
+    bool is_back_edge(uint32_t from, uint32_t to) const;
+};
+
+// True for instructions after which execution does not continue with the next instruction
+bool is_terminator(opcode op);
+
+bool is_unconditional_jump(opcode op);
+
+control_flow_graph build_control_flow_graph(const JSFunctionBytecode * b);
+
+#endif //CONTROL_FLOW_H
@@ -1,7 +1,19 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cctype>
+#include <charconv>
+#include <filesystem>
 #include <format>
 #include <fstream>
 #include <iostream>
+#include <map>
+#include <mutex>
+#include <optional>
 #include <sstream>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
 
 #include <boost/program_options.hpp>
 
@@ -9,92 +21,1965 @@
 #include "quickjs.h"
 #include "utilities.h"
 
+#include "bytecode_lint.h"
+#include "content_cache.h"
+#include "input_files.h"
+#include "mapped_file.h"
+#include "control_flow.h"
+#include "instruction_decoder.h"
+#include "interrupt_polls.h"
+#include "memory_footprint.h"
+#include "opcode_stats.h"
+#include "opcodes.h"
+#include "output_writer.h"
+#include "pc2line_reader.h"
 #include "quickjs_bytecode.h"
+#include "sequence_diff.h"
+#include "short_forms.h"
+#include "stack_analysis.h"
 
 namespace po = boost::program_options;
 
-struct instruction {
+enum class report_kind {
+    disassembly,
+    // The stack depth of each function checked against its stack_size, and the largest frames
+    stack,
+    // Opcode, operand format and instruction size counts over all functions of all files
+    stats,
+    // The memory held by each function, and by each file compared with its stripped variants
+    memory,
+    // How the bytecode of each function changed between two versions of a script
+    diff,
+    // Instructions encoded in a longer form than a compact one their operands fit
+    short_forms,
+    // Instructions matching known slow patterns, deepest loops first
+    lint,
+    // Interrupt poll sites of each function and the longest stretches of instructions between them
+    poll_gaps,
+};
+
+enum class output_format {
+    text,
+    // One JSON record per line for each function and instruction
+    json,
+    // A Graphviz graph of the basic blocks of each function
+    dot,
+};
+
+enum class source_type {
+    // Scripts, except .mjs files and files with import or export declarations or import.meta
+    automatic,
+    script,
+    module,
+};
+
+struct disassembly_options {
+    // Inputs are serialized bytecode files instead of source code
+    bool bytecode;
+    source_type source;
+    bool strip;
+    output_format format;
+    // Print the basic blocks and loops of each function after its instructions
+    bool control_flow;
+    // Tag each instruction with the line and column it was compiled from
+    bool positions;
+    // Print each source line before the instructions compiled from it, instead of each function's whole source
+    bool interleave;
+    // Mark the instructions which poll for interrupts
+    bool polls;
+    report_kind report;
+    // Bytecode compiled and results rendered by earlier runs, nullptr to compile and render every file
+    const content_cache * cache;
+};
+
+struct strip_variant {
+    std::string_view name;
+    // JS_WriteObject flags the variant is written with
+    int flags;
+};
+
+// The variants compared by --memory. Stripping the debug information also strips the source,
+// which is only written as part of it, as qjsc -s -s does.
+constexpr std::array<strip_variant, 3> strip_variants{{
+    {"unstripped", 0},
+    {"strip source", JS_WRITE_OBJ_STRIP_SOURCE},
+    {"strip debug", JS_WRITE_OBJ_STRIP_SOURCE | JS_WRITE_OBJ_STRIP_DEBUG},
+}};
+
+using variant_footprints = std::array<memory_footprint, strip_variants.size()>;
+
+struct frame_entry {
+    std::string function;
+    std::string filename;
+    int line;
+    uint32_t frame_size;
+    uint16_t arg_count;
+    uint16_t var_count;
+    uint16_t stack_size;
+};
+
+// A stretch of instructions without an interrupt poll, for the --poll-gaps ranking
+struct poll_gap_entry {
+    std::string function;
+    std::string filename;
+    int line;
+    poll_stretch stretch;
+};
+
+struct file_result {
+    std::string output;
+    // Why the file could not be disassembled, empty on success
+    std::string error;
+
+    // Functions of the file, for the --stack ranking
+    std::vector<frame_entry> frames;
+    // Number of functions whose bytecode failed the stack depth check
+    int stack_failures = 0;
+
+    opcode_stats stats;
+    // Memory held by the functions of the file after a round trip through each strip variant
+    variant_footprints memory{};
+    short_form_totals short_forms;
+    // Lint findings by rule
+    lint_counts lint{};
+
+    std::vector<poll_gap_entry> poll_gaps;
+    // Number of functions with a loop which never polls for interrupts
+    int unbounded_polls = 0;
+};
+
+struct dump_context {
+    JSContext * ctx;
+    output_writer * out;
+    const disassembly_options * options;
+    std::string_view filename;
+    file_result * result;
+
+    // Constant pool indices leading from the top level function to the current one
+    std::vector<uint32_t> path;
+    // Functions already reached; the same function can sit in more than one constant pool entry
+    std::unordered_set<const JSFunctionBytecode *> visited;
+
+    // Atom names are looked up once; JS_AtomToCString allocates a new string on every call
+    std::unordered_map<JSAtom, std::string> atom_names;
+
+    // Lines of the compiled source file for the interleaved view, empty for bytecode inputs
+    std::vector<std::string_view> source_lines;
+};
+
+const std::string & atom_name(dump_context & dc, const JSAtom atom) {
+    auto it = dc.atom_names.find(atom);
+    if (it == dc.atom_names.end()) {
+        const char * str = JS_AtomToCString(dc.ctx, atom);
+        it = dc.atom_names.emplace(atom, str ? str : "<invalid atom>").first;
+        JS_FreeCString(dc.ctx, str);
+    }
+    return it->second;
+}
+
+std::string_view function_name(dump_context & dc, const JSFunctionBytecode * b) {
+    return b->func_name == JS_ATOM_NULL ? "<anonymous>" : std::string_view(atom_name(dc, b->func_name));
+}
+
+// Name of a local variable, argument or closure variable operand, or nullptr if the function has no names for them
+const std::string * variable_name(dump_context & dc, const JSFunctionBytecode * b, const operand & op) {
+    const JSVarDef * vars = nullptr;
+    int count = 0;
+
+    switch (op.kind) {
+        case operand_local:
+            vars = b->vardefs ? b->vardefs + b->arg_count : nullptr;
+            count = b->var_count;
+            break;
+        case operand_arg:
+            vars = b->vardefs;
+            count = b->arg_count;
+            break;
+        case operand_var_ref:
+            if (b->closure_var == nullptr || op.value >= b->closure_var_count) return nullptr;
+            return &atom_name(dc, b->closure_var[op.value].var_name);
+        default:
+            return nullptr;
+    }
+
+    if (vars == nullptr || op.value >= count) return nullptr;
+    return &atom_name(dc, vars[op.value].var_name);
+}
+
+// Short description of a constant pool entry, or an empty string if the index is out of range
+std::string constant_description(dump_context & dc, const JSFunctionBytecode * b, const int64_t idx) {
+    if (idx >= b->cpool_count) return {};
+
+    const JSValue value = b->cpool[idx];
+
+    switch (JS_VALUE_GET_TAG(value)) {
+        case JS_TAG_FUNCTION_BYTECODE: {
+            const auto * function = static_cast<JSFunctionBytecode *>(JS_VALUE_GET_PTR(value));
+            if (function->func_name == JS_ATOM_NULL) {
+                return "<anonymous function>";
+            }
+            return std::format("<function {}>", atom_name(dc, function->func_name));
+        }
+        case JS_TAG_OBJECT:
+            return "<object>";
+        default: {
+            const char * str = JS_ToCString(dc.ctx, value);
+            std::string description = str ? str : "<value>";
+            JS_FreeCString(dc.ctx, str);
+            if (JS_IsString(value)) {
+                return std::format("\"{}\"", description);
+            }
+            return description;
+        }
+    }
+}
+
+void write_operand(dump_context & dc, const JSFunctionBytecode * b, const operand & op) {
+    output_writer & out = *dc.out;
+
+    switch (op.kind) {
+        case operand_int:
+            out.format("{}", op.value);
+            break;
+        case operand_local:
+        case operand_arg:
+        case operand_var_ref: {
+            const std::string * name = variable_name(dc, b, op);
+            if (name == nullptr) {
+                out.format("{}", op.value);
+            } else {
+                out.format("{} ({})", op.value, *name);
+            }
+            break;
+        }
+        case operand_const: {
+            out.format("{}", op.value);
+            const std::string description = constant_description(dc, b, op.value);
+            if (!description.empty()) {
+                out.format(": {}", description);
+            }
+            break;
+        }
+        case operand_label:
+            out.format("-> {}", op.value);
+            break;
+        case operand_atom:
+            out.write(atom_name(dc, static_cast<JSAtom>(op.value)));
+            break;
+        case operand_argc:
+            out.format("argc={}", op.value);
+            break;
+        case operand_scope:
+            out.format("scope={}", op.value);
+            break;
+    }
+}
+
+void write_operands(dump_context & dc, const JSFunctionBytecode * b, const decoded_instruction & insn) {
+    for (int i = 0; i < insn.operand_count; i++) {
+        dc.out->write(i == 0 ? " " : ", ");
+        write_operand(dc, b, insn.operands[i]);
+    }
+}
+
+void write_source(dump_context & dc, const JSFunctionBytecode * b, const int indent) {
+    output_writer & out = *dc.out;
+
+    out.indent(indent);
+    out.format("Source (Line {}):\n", b->line_num);
+    out.indent(indent + 1);
+
+    const std::string_view source(b->source, b->source_len);
+    size_t start = 0;
+
+    // Copy whole lines at a time, indenting after every newline
+    for (size_t newline = source.find('\n'); newline != std::string_view::npos; newline = source.find('\n', start)) {
+        out.write(source.substr(start, newline + 1 - start));
+        out.indent(indent + 1);
+        start = newline + 1;
+    }
+
+    out.write(source.substr(start));
+    out.newline();
+}
+
+// Splits text at its newlines, dropping them and any carriage returns before them
+void split_lines(const std::string_view text, std::vector<std::string_view> & lines) {
+    size_t start = 0;
+
+    while (start < text.size()) {
+        size_t end = text.find('\n', start);
+        if (end == std::string_view::npos) end = text.size();
+
+        std::string_view line = text.substr(start, end - start);
+        if (line.ends_with('\r')) line.remove_suffix(1);
+        lines.push_back(line);
+
+        start = end + 1;
+    }
+}
+
+// Text of a source line for the interleaved view, taken from the compiled file or, for bytecode
+// inputs, from the function's own source, which starts partway into its first line
+std::string_view source_line(const dump_context & dc, const JSFunctionBytecode * b, const int line) {
+    if (!dc.source_lines.empty()) {
+        return line >= 1 && line <= static_cast<int>(dc.source_lines.size()) ? dc.source_lines[line - 1] : std::string_view{};
+    }
+
+    if (b->source == nullptr || line < b->line_num) return {};
+
+    std::string_view source(b->source, b->source_len);
+    for (int i = b->line_num; i < line; i++) {
+        const size_t newline = source.find('\n');
+        if (newline == std::string_view::npos) return {};
+        source.remove_prefix(newline + 1);
+    }
+
+    return source.substr(0, source.find('\n'));
+}
+
+// Writes the fields shared by all JSON records of the current function
+void write_json_record_start(dump_context & dc, const std::string_view type) {
+    output_writer & out = *dc.out;
+
+    out.write("{\"type\":");
+    out.json_string(type);
+    out.write(",\"file\":");
+    out.json_string(dc.filename);
+    out.write(",\"path\":[");
+    for (size_t i = 0; i < dc.path.size(); i++) {
+        if (i > 0) out.put(',');
+        out.format("{}", dc.path[i]);
+    }
+    out.put(']');
+}
+
+void write_json_function(dump_context & dc, const JSFunctionBytecode * b) {
+    output_writer & out = *dc.out;
+
+    write_json_record_start(dc, "function");
+    out.write(",\"name\":");
+    out.json_string(b->func_name == JS_ATOM_NULL ? "" : atom_name(dc, b->func_name));
+    out.format(",\"line\":{},\"col\":{},\"arg_count\":{},\"var_count\":{},\"closure_var_count\":{}"
+               ",\"cpool_count\":{},\"stack_size\":{},\"bytecode_len\":{}}}\n",
+               b->line_num, b->col_num, b->arg_count, b->var_count, b->closure_var_count,
+               b->cpool_count, b->stack_size, b->byte_code_len);
+}
+
+void write_json_instruction(dump_context & dc, const JSFunctionBytecode * b, const decoded_instruction & insn,
+                            const source_position position) {
+    output_writer & out = *dc.out;
+
+    write_json_record_start(dc, "instruction");
+    out.format(",\"offset\":{},\"opcode\":", insn.pos);
+    out.json_string(insn.info->name);
+    out.format(",\"size\":{},\"line\":{},\"col\":{},\"operands\":[", insn.info->size, position.line, position.col);
+
+    for (int i = 0; i < insn.operand_count; i++) {
+        const operand & op = insn.operands[i];
+        if (i > 0) out.put(',');
+
+        out.write("{\"kind\":");
+        out.json_string(operand_kind_name(op.kind));
+
+        if (op.kind == operand_atom) {
+            out.write(",\"name\":");
+            out.json_string(atom_name(dc, static_cast<JSAtom>(op.value)));
+        } else {
+            out.format(",\"value\":{}", op.value);
+        }
+
+        if (const std::string * name = variable_name(dc, b, op)) {
+            out.write(",\"name\":");
+            out.json_string(*name);
+        } else if (op.kind == operand_const) {
+            const std::string description = constant_description(dc, b, op.value);
+            if (!description.empty()) {
+                out.write(",\"constant\":");
+                out.json_string(description);
+            }
+        }
+
+        out.put('}');
+    }
+
+    out.write("]}\n");
+}
+
+void write_block_list(output_writer & out, const std::vector<uint32_t> & blocks, const std::string_view prefix) {
+    for (size_t i = 0; i < blocks.size(); i++) {
+        out.format("{}B{}", i == 0 ? prefix : ", ", blocks[i]);
+    }
+}
+
+void write_control_flow(dump_context & dc, const JSFunctionBytecode * b, const int indent) {
+    const control_flow_graph cfg = build_control_flow_graph(b);
+    output_writer & out = *dc.out;
+
+    out.indent(indent);
+    out.write("Control Flow:\n");
+    out.indent(indent + 1);
+    out.write("Blocks:\n");
+
+    for (uint32_t i = 0; i < cfg.blocks.size(); i++) {
+        const basic_block & block = cfg.blocks[i];
+
+        out.indent(indent + 2);
+        out.format("B{}: {}-{}, {} instruction(s)", i, block.start, block.last, block.instruction_count);
+
+        if (!block.reachable) {
+            out.write(", unreachable");
+        } else if (block.loop != NO_LOOP) {
+            out.format(", loop L{} (depth {})", block.loop, cfg.loop_depth(i));
+        }
+
+        write_block_list(out, block.successors, " -> ");
+        out.newline();
+    }
+
+    if (cfg.loops.empty()) return;
+
+    out.indent(indent + 1);
+    out.write("Loops:\n");
+
+    for (uint32_t i = 0; i < cfg.loops.size(); i++) {
+        const natural_loop & loop = cfg.loops[i];
+
+        uint32_t instruction_count = 0;
+        for (const uint32_t block : loop.blocks) {
+            instruction_count += cfg.blocks[block].instruction_count;
+        }
+
+        out.indent(indent + 2);
+        out.format("L{}: header B{} (offset {}), depth {}", i, loop.header, cfg.blocks[loop.header].start, loop.depth);
+        if (loop.parent != NO_LOOP) {
+            out.format(", inside L{}", loop.parent);
+        }
+        out.format(", {} instruction(s) in", instruction_count);
+        write_block_list(out, loop.blocks, " ");
+        write_block_list(out, loop.latches, ", back edge(s) from ");
+        out.newline();
+    }
+}
+
+// Identifier of the current function in a Graphviz graph
+std::string dot_function_id(const dump_context & dc) {
+    std::string id = "f";
+    for (const uint32_t index : dc.path) {
+        id += std::format("_{}", index);
+    }
+    return id;
+}
+
+// Writes text as a quoted Graphviz label with left-justified lines
+void write_dot_label(output_writer & out, const std::string_view text) {
+    out.put('"');
+    for (const char c : text) {
+        if (c == '\n') {
+            out.write("\\l");
+        } else {
+            if (c == '"' || c == '\\') out.put('\\');
+            out.put(c);
+        }
+    }
+    out.put('"');
+}
+
+// Writes the function's basic blocks as a cluster of nodes listing their instructions.
+// Loop headers are drawn bold and back edges red.
+void write_dot_function(dump_context & dc, const JSFunctionBytecode * b) {
+    const control_flow_graph cfg = build_control_flow_graph(b);
+    const std::string id = dot_function_id(dc);
+    output_writer & out = *dc.out;
+
+    out.format("  subgraph cluster_{} {{\n    label=", id);
+    write_dot_label(out, std::format("{} (line {})", function_name(dc, b), b->line_num));
+    out.write(";\n");
+
+    // Instructions are rendered as in text output into a separate buffer, then escaped into the label
+    output_writer label;
+    output_writer * const graph_out = std::exchange(dc.out, &label);
+
+    for (uint32_t i = 0; i < cfg.blocks.size(); i++) {
+        const basic_block & block = cfg.blocks[i];
+
+        label.format("B{}\n", i);
+        for (uint32_t pos = block.start; pos < block.end; pos += get_instruction(b->byte_code_buf[pos]).size) {
+            const decoded_instruction insn = decode_instruction(b, pos);
+            label.format("{}: {}", pos, insn.info->name);
+            write_operands(dc, b, insn);
+            label.newline();
+        }
+
+        const bool is_header = block.loop != NO_LOOP && cfg.loops[block.loop].header == i;
+        out.format("    {}_b{} [shape=box, fontname=monospace{}{}, label=", id, i,
+                   is_header ? ", style=bold" : "", block.reachable ? "" : ", color=gray");
+        write_dot_label(out, label.take());
+        out.write("];\n");
+    }
+
+    dc.out = graph_out;
+
+    for (uint32_t i = 0; i < cfg.blocks.size(); i++) {
+        for (const uint32_t successor : cfg.blocks[i].successors) {
+            out.format("    {}_b{} -> {}_b{}{};\n", id, i, id, successor,
+                       cfg.is_back_edge(i, successor) ? " [color=red]" : "");
+        }
+    }
+
+    out.write("  }\n");
+}
+
+void dump_bytecode(dump_context & dc, const JSFunctionBytecode * b, const int indent) {
+    const uint8_t * bytecode = b->byte_code_buf;
+    const size_t bytecode_len = b->byte_code_len;
+    const bool json = dc.options->format == output_format::json;
+    output_writer & out = *dc.out;
+
+    const bool interleave = dc.options->interleave && !json;
+
+    if (json) {
+        write_json_function(dc, b);
+    } else if (b->source_len > 0 && !dc.options->strip && !interleave) {
+        write_source(dc, b, indent);
+    }
+
+    pc2line_reader lines(b);
+    int previous_line = 0;
+    size_t i = 0;
+
+    while (i < bytecode_len) {
+        const decoded_instruction insn = decode_instruction(b, i);
+        const instruction & info = *insn.info;
+        const source_position position = lines.at(i);
+
+        // The source line is repeated whenever the code returns to it, as at the condition of a loop
+        if (interleave && position.line != previous_line && position.line > 0) {
+            out.indent(indent);
+            out.format("; {:4} |", position.line);
+            const std::string_view text = dc.options->strip ? std::string_view{} : source_line(dc, b, position.line);
+            if (!text.empty()) {
+                out.put(' ');
+                out.write(text);
+            }
+            out.newline();
+            previous_line = position.line;
+        }
+
+        if (json) {
+            write_json_instruction(dc, b, insn, position);
+        } else {
+            out.indent(indent);
+            out.format("{:5}: {:#04x} ({})", i, bytecode[i], info.name);
+            write_operands(dc, b, insn);
+            if (dc.options->positions) {
+                out.format("  @{}:{}", position.line, position.col);
+            }
+            if (dc.options->polls) {
+                switch (instruction_poll_kind(info.id)) {
+                    case poll_kind::always: out.write("  [poll]"); break;
+                    case poll_kind::may: out.write("  [may poll]"); break;
+                    case poll_kind::none: break;
+                }
+            }
+            out.newline();
+        }
+
+        // Functions are listed where they are created
+        if (info.id == op_fclosure8 || info.id == op_fclosure) {
+            const auto loc = static_cast<uint32_t>(insn.operands[0].value);
+            const auto * closure_bytecode = static_cast<JSFunctionBytecode *>(JS_VALUE_GET_PTR(b->cpool[loc]));
+            if (dc.visited.insert(closure_bytecode).second) {
+                dc.path.push_back(loc);
+                dump_bytecode(dc, closure_bytecode, indent + 1);
+                dc.path.pop_back();
+                // Show where the function continues after the nested listing
+                previous_line = 0;
+            }
+        }
+
+        i += info.size;
+    }
+
+    // and any which no fclosure creates after the instructions
+    for (uint32_t loc = 0; loc < static_cast<uint32_t>(b->cpool_count); loc++) {
+        if (JS_VALUE_GET_TAG(b->cpool[loc]) != JS_TAG_FUNCTION_BYTECODE) continue;
+
+        const auto * function = static_cast<JSFunctionBytecode *>(JS_VALUE_GET_PTR(b->cpool[loc]));
+        if (!dc.visited.insert(function).second) continue;
+
+        if (!json) {
+            out.indent(indent + 1);
+            out.format("Constant {}:\n", loc);
+        }
+
+        dc.path.push_back(loc);
+        dump_bytecode(dc, function, indent + 1);
+        dc.path.pop_back();
+    }
+
+    if (dc.options->control_flow && !json) {
+        write_control_flow(dc, b, indent);
+    }
+}
+
+template <typename Visit>
+void walk_function_tree(dump_context & dc, const JSFunctionBytecode * b, Visit & visit) {
+    if (!dc.visited.insert(b).second) return;
+
+    visit(dc, b);
+
+    for (uint32_t loc = 0; loc < static_cast<uint32_t>(b->cpool_count); loc++) {
+        if (JS_VALUE_GET_TAG(b->cpool[loc]) != JS_TAG_FUNCTION_BYTECODE) continue;
+
+        dc.path.push_back(loc);
+        walk_function_tree(dc, static_cast<JSFunctionBytecode *>(JS_VALUE_GET_PTR(b->cpool[loc])), visit);
+        dc.path.pop_back();
+    }
+}
+
+// Calls visit for the function and every function in its constant pool, depth first and in pool order,
+// with dc.path set to the path of the visited function. Each function is visited once.
+template <typename Visit>
+void walk_functions(dump_context & dc, const JSFunctionBytecode * b, Visit && visit) {
+    dc.visited.clear();
+    walk_function_tree(dc, b, visit);
+}
+
+// Writes the computed stack depth of the function next to its stack_size, followed by any
+// problems found, and records its frame for the ranking
+void write_stack_report(dump_context & dc, const JSFunctionBytecode * b) {
+    const control_flow_graph cfg = build_control_flow_graph(b);
+    const stack_analysis stack = analyze_stack(b, cfg);
+    output_writer & out = *dc.out;
+
+    out.format("{} (line {}): max depth {} at {}, stack_size {}, frame {} bytes\n",
+               function_name(dc, b), b->line_num, stack.max_depth, stack.max_depth_pos, b->stack_size, frame_size(b));
+
+    for (const auto & issue : stack.issues) {
+        out.indent(1);
+        out.format("{}: {}\n", issue.pos, issue.message);
+    }
+
+    if (stack.max_depth != b->stack_size) {
+        out.indent(1);
+        out.format("max depth {} does not match stack_size {}\n", stack.max_depth, b->stack_size);
+    }
+
+    if (!stack.issues.empty() || stack.max_depth != b->stack_size) {
+        dc.result->stack_failures++;
+    }
+
+    dc.result->frames.push_back({
+        .function = std::string(function_name(dc, b)),
+        .filename = std::string(dc.filename),
+        .line = b->line_num,
+        .frame_size = frame_size(b),
+        .arg_count = b->arg_count,
+        .var_count = b->var_count,
+        .stack_size = b->stack_size,
+    });
+}
+
+void add_stats(dump_context & dc, const JSFunctionBytecode * b) {
+    dc.result->stats.add_function(b);
+}
+
+// Lists the instructions of the function which a compact form would have encoded in fewer bytes
+void write_missed_short_forms(dump_context & dc, const JSFunctionBytecode * b, const short_form_atoms & atoms) {
+    const control_flow_graph cfg = build_control_flow_graph(b);
+    const std::vector<missed_short_form> misses = find_missed_short_forms(b, cfg, atoms);
+    output_writer & out = *dc.out;
+
+    dc.result->short_forms.add_function(b, misses);
+    if (misses.empty()) return;
+
+    uint32_t saved = 0;
+    for (const auto & miss : misses) saved += miss.saved;
+
+    out.format("{} (line {}): {} missed short form(s), {} of {} byte(s) could be saved\n",
+               function_name(dc, b), b->line_num, misses.size(), saved, b->byte_code_len);
+
+    for (const auto & miss : misses) {
+        const decoded_instruction insn = decode_instruction(b, miss.pos);
+        out.indent(1);
+        out.format("{:5}: {}", miss.pos, insn.info->name);
+        write_operands(dc, b, insn);
+        out.format(": could be {}, saving {} byte(s)\n", get_instruction(miss.short_op).name, miss.saved);
+    }
+}
+
+// A lint finding with the function it was found in, for ranking the findings of a whole file
+struct lint_entry {
+    const JSFunctionBytecode * function;
+    lint_finding finding;
+    source_position position;
+};
+
+void write_lint_counts(output_writer & out, const lint_counts & counts) {
+    uint64_t total = 0;
+    for (const uint64_t count : counts) total += count;
+
+    if (total == 0) {
+        out.write("No findings\n");
+        return;
+    }
+
+    out.format("{} finding(s):", total);
+    const char * separator = " ";
+    for (size_t i = 0; i < counts.size(); i++) {
+        if (counts[i] == 0) continue;
+        out.format("{}{} {}", separator, counts[i], lint_rule_names[i]);
+        separator = ", ";
+    }
+    out.newline();
+}
+
+// Lists the findings of every function of the file, those in the deepest loops first
+void write_lint_report(dump_context & dc, const JSFunctionBytecode * b) {
+    std::vector<lint_entry> entries;
+    output_writer & out = *dc.out;
+
+    walk_functions(dc, b, [&](dump_context &, const JSFunctionBytecode * function) {
+        const control_flow_graph cfg = build_control_flow_graph(function);
+        pc2line_reader lines(function);
+
+        for (const lint_finding & finding : lint_function(function, cfg)) {
+            entries.push_back({function, finding, lines.at(finding.pos)});
+        }
+    });
+
+    std::stable_sort(entries.begin(), entries.end(), [](const lint_entry & a, const lint_entry & b) {
+        return a.finding.loop_depth > b.finding.loop_depth;
+    });
+
+    lint_counts counts{};
+
+    for (const auto & entry : entries) {
+        const decoded_instruction insn = decode_instruction(entry.function, entry.finding.pos);
+        counts[static_cast<size_t>(entry.finding.rule)]++;
+
+        out.format("loop depth {}: {} in {}", entry.finding.loop_depth,
+                   lint_rule_names[static_cast<size_t>(entry.finding.rule)], function_name(dc, entry.function));
+        if (entry.position.line > 0) {
+            out.format(" at {}:{}", entry.position.line, entry.position.col);
+        }
+        out.format(", {}: {}", entry.finding.pos, insn.info->name);
+        write_operands(dc, entry.function, insn);
+        out.newline();
+    }
+
+    write_lint_counts(out, counts);
+    for (size_t i = 0; i < counts.size(); i++) dc.result->lint[i] += counts[i];
+}
+
+// Writes the poll sites of the function and its longest stretch without a poll, and records its stretches
+// for the ranking
+void write_poll_gaps(dump_context & dc, const JSFunctionBytecode * b) {
+    const control_flow_graph cfg = build_control_flow_graph(b);
+    const poll_map map = map_interrupt_polls(b, cfg);
+    output_writer & out = *dc.out;
+
+    out.format("{} (line {}): {} poll site(s), {} that may poll", function_name(dc, b), b->line_num,
+               map.always_sites, map.may_sites);
+    if (!map.stretches.empty()) {
+        const poll_stretch & longest = map.stretches.front();
+        out.format(", longest stretch without a poll {} instruction(s) at {}-{}",
+                   longest.instruction_count, longest.start, longest.end);
+    }
+    out.newline();
+
+    if (map.unbounded) {
+        out.indent(1);
+        out.write("a loop can run without polling\n");
+        dc.result->unbounded_polls++;
+    }
+
+    for (const auto & stretch : map.stretches) {
+        dc.result->poll_gaps.push_back({
+            .function = std::string(function_name(dc, b)),
+            .filename = std::string(dc.filename),
+            .line = b->line_num,
+            .stretch = stretch,
+        });
+    }
+}
+
+void write_short_form_totals(output_writer & out, const short_form_totals & totals) {
+    const double percent = totals.bytes == 0 ? 0.0 : 100.0 * static_cast<double>(totals.saved) / static_cast<double>(totals.bytes);
+    out.format("{} missed short form(s) in {} function(s), {} of {} bytecode byte(s) ({:.2f}%) could be saved\n",
+               totals.missed, totals.functions, totals.saved, totals.bytes, percent);
+}
+
+void dump_bytecode(dump_context & dc, const JSFunctionBytecode * b) {
+    if (dc.options->report == report_kind::stack) {
+        walk_functions(dc, b, write_stack_report);
+    } else if (dc.options->report == report_kind::stats) {
+        walk_functions(dc, b, add_stats);
+    } else if (dc.options->report == report_kind::short_forms) {
+        const short_form_totals before = dc.result->short_forms;
+        const short_form_atoms atoms{
+            .length = JS_NewAtom(dc.ctx, "length"),
+            .empty_string = JS_NewAtom(dc.ctx, ""),
+        };
+
+        walk_functions(dc, b, [&](dump_context & context, const JSFunctionBytecode * function) {
+            write_missed_short_forms(context, function, atoms);
+        });
+
+        JS_FreeAtom(dc.ctx, atoms.length);
+        JS_FreeAtom(dc.ctx, atoms.empty_string);
+
+        short_form_totals file_totals = dc.result->short_forms;
+        file_totals.functions -= before.functions;
+        file_totals.bytes -= before.bytes;
+        file_totals.missed -= before.missed;
+        file_totals.saved -= before.saved;
+        write_short_form_totals(*dc.out, file_totals);
+    } else if (dc.options->report == report_kind::lint) {
+        write_lint_report(dc, b);
+    } else if (dc.options->report == report_kind::poll_gaps) {
+        walk_functions(dc, b, write_poll_gaps);
+    } else if (dc.options->format == output_format::dot) {
+        dc.out->write("digraph ");
+        write_dot_label(*dc.out, dc.filename);
+        dc.out->write(" {\n");
+        walk_functions(dc, b, write_dot_function);
+        dc.out->write("}\n");
+    } else {
+        dc.visited = {b};
+        dump_bytecode(dc, b, 0);
+    }
+}
+
+// Takes the pending exception from the context as an error message
+std::string take_exception(JSContext * ctx) {
+    const JSValue exception = JS_GetException(ctx);
+    std::string message = exception_to_string(ctx, exception);
+    JS_FreeValue(ctx, exception);
+    return message;
+}
+
+// The function run by a compiled or loaded script or module, or nullptr if obj is neither
+const JSFunctionBytecode * top_level_function(const JSValue obj) {
+    JSValue function = obj;
+
+    if (JS_VALUE_GET_TAG(obj) == JS_TAG_MODULE) {
+        function = static_cast<JSModuleDef *>(JS_VALUE_GET_PTR(obj))->func_obj;
+    }
+
+    if (JS_VALUE_GET_TAG(function) != JS_TAG_FUNCTION_BYTECODE) return nullptr;
+    return static_cast<JSFunctionBytecode *>(JS_VALUE_GET_PTR(function));
+}
+
+// Why a compiled or loaded object cannot be disassembled, or an empty string if it can
+std::string_view unsupported_object(const JSValue obj) {
+    if (top_level_function(obj) == nullptr) return "Bytecode does not contain a script or module function";
+    return {};
+}
+
+// Writes the name of a module and the modules it imports from
+void write_module_header(dump_context & dc, const JSModuleDef * m) {
+    output_writer & out = *dc.out;
+
+    out.format("Module: {}\n", atom_name(dc, m->module_name));
+
+    for (int i = 0; i < m->req_module_entries_count; i++) {
+        out.indent(1);
+        out.format("Imports: {}\n", atom_name(dc, m->req_module_entries[i].module_name));
+    }
+}
+
+// Writes what the function itself holds, without the functions nested in it
+void write_function_footprint(dump_context & dc, const JSFunctionBytecode * b) {
+    memory_footprint footprint;
+    footprint.add_function(b);
+
+    dc.out->format("{} (line {}): {} bytes: header {}, bytecode {}, cpool {}, vardefs {}, closure vars {}, pc2line {}, source {}\n",
+                   function_name(dc, b), b->line_num, footprint.total(), footprint.header, footprint.bytecode,
+                   footprint.cpool, footprint.vardefs, footprint.closure_vars, footprint.pc2line, footprint.source);
+}
+
+void write_footprint_table(output_writer & out, const variant_footprints & footprints) {
+    out.format("{:<14}{:>10}{:>12}{:>10}{:>10}{:>10}{:>10}{:>10}{:>10}{:>10}{:>12}\n", "variant", "functions", "memory",
+               "header", "bytecode", "cpool", "vardefs", "closure", "pc2line", "source", "serialized");
+
+    for (size_t i = 0; i < strip_variants.size(); i++) {
+        const memory_footprint & footprint = footprints[i];
+        out.format("{:<14}{:>10}{:>12}{:>10}{:>10}{:>10}{:>10}{:>10}{:>10}{:>10}{:>12}\n", strip_variants[i].name,
+                   footprint.functions, footprint.total(), footprint.header, footprint.bytecode, footprint.cpool,
+                   footprint.vardefs, footprint.closure_vars, footprint.pc2line, footprint.source, footprint.serialized);
+    }
+}
+
+// Lists the footprint of each function of a compiled script, then measures each strip variant by writing
+// the script with its flags and reading it back, the way an embedder loading qjsc output would.
+bool write_memory_report(dump_context & dc, const JSValue obj) {
+    walk_functions(dc, top_level_function(obj), write_function_footprint);
+
+    variant_footprints footprints{};
+
+    for (size_t i = 0; i < strip_variants.size(); i++) {
+        size_t size;
+        uint8_t * data = JS_WriteObject(dc.ctx, &size, obj, JS_WRITE_OBJ_BYTECODE | strip_variants[i].flags);
+        if (data == nullptr) {
+            dc.result->error = take_exception(dc.ctx);
+            return false;
+        }
+
+        const JSValue copy = JS_ReadObject(dc.ctx, data, size, JS_READ_OBJ_BYTECODE);
+        js_free(dc.ctx, data);
+        if (JS_IsException(copy)) {
+            dc.result->error = take_exception(dc.ctx);
+            return false;
+        }
+
+        footprints[i].serialized = size;
+        walk_functions(dc, top_level_function(copy),
+                       [&](dump_context &, const JSFunctionBytecode * b) { footprints[i].add_function(b); });
+        JS_FreeValue(dc.ctx, copy);
+
+        dc.result->memory[i] += footprints[i];
+    }
+
+    write_footprint_table(*dc.out, footprints);
+    return true;
+}
+
+// Disassembles a compiled script or module into out. Returns false and sets the result's error if obj is neither.
+// source is the text obj was compiled from, if it is at hand.
+bool dump_object(JSContext * ctx, const JSValue obj, const std::string_view name, const disassembly_options & options,
+                 output_writer & out, file_result & result, const std::string_view source = {}) {
+    result.error = unsupported_object(obj);
+    if (!result.error.empty()) {
+        return false;
+    }
+
+    dump_context dc{
+        .ctx = ctx,
+        .out = &out,
+        .options = &options,
+        .filename = name,
+        .result = &result,
+        .path = {},
+        .visited = {},
+        .atom_names = {},
+        .source_lines = {},
+    };
+
+    if (options.interleave) {
+        split_lines(source, dc.source_lines);
+    }
+
+    if (options.report == report_kind::memory) {
+        return write_memory_report(dc, obj);
+    }
+
+    if (JS_VALUE_GET_TAG(obj) == JS_TAG_MODULE && options.report == report_kind::disassembly
+        && options.format == output_format::text) {
+        write_module_header(dc, static_cast<JSModuleDef *>(JS_VALUE_GET_PTR(obj)));
+    }
+
+    dump_bytecode(dc, top_level_function(obj));
+    return true;
+}
+
+// Loads serialized bytecode, as written by JS_WriteObject or qjsc, and disassembles it into out
+bool dump_serialized(JSContext * ctx, const uint8_t * data, const size_t size, const std::string_view name,
+                     const disassembly_options & options, output_writer & out, file_result & result) {
+    const JSValue obj = JS_ReadObject(ctx, data, size, JS_READ_OBJ_BYTECODE);
+    if (JS_IsException(obj)) {
+        result.error = take_exception(ctx);
+        return false;
+    }
+
+    const bool success = dump_object(ctx, obj, name, options, out, result);
+    JS_FreeValue(ctx, obj);
+    return success;
+}
+
+struct byte_array {
+    std::string_view name;
+    std::vector<uint8_t> bytes;
+};
+
+bool is_identifier_char(const char c) {
+    return std::isalnum(static_cast<unsigned char>(c)) || c == '_';
+}
+
+size_t skip_space(const std::string_view text, size_t pos) {
+    while (pos < text.size() && std::isspace(static_cast<unsigned char>(text[pos]))) pos++;
+    return pos;
+}
+
+// Parses the initializer list of a byte array starting after its opening brace. Returns the position
+// after the closing brace, or std::string_view::npos if the list is not made up of byte values.
+size_t parse_byte_list(const std::string_view text, size_t pos, std::vector<uint8_t> & bytes) {
+    for (;;) {
+        pos = skip_space(text, pos);
+        if (pos >= text.size()) return std::string_view::npos;
+        if (text[pos] == '}') return pos + 1;
+
+        int base = 10;
+        if (text.substr(pos, 2) == "0x" || text.substr(pos, 2) == "0X") {
+            base = 16;
+            pos += 2;
+        }
+
+        unsigned int value;
+        const auto [end, ec] = std::from_chars(text.data() + pos, text.data() + text.size(), value, base);
+        if (ec != std::errc() || value > 0xff) return std::string_view::npos;
+        bytes.push_back(static_cast<uint8_t>(value));
+
+        pos = skip_space(text, end - text.data());
+        if (pos < text.size() && text[pos] == ',') pos++;
+    }
+}
+
+// Finds the bytecode arrays in a C file generated by qjsc, which are declared as
+// const uint8_t name[size] = { 0x.., ... };
+bool parse_c_arrays(const std::string_view text, std::vector<byte_array> & arrays, std::string & error) {
+    constexpr std::string_view type = "uint8_t";
+
+    for (size_t pos = text.find(type); pos != std::string_view::npos; pos = text.find(type, pos)) {
+        const bool type_starts_word = pos == 0 || !is_identifier_char(text[pos - 1]);
+        pos += type.size();
+        if (!type_starts_word || pos >= text.size() || is_identifier_char(text[pos])) continue;
+
+        const size_t name_start = skip_space(text, pos);
+        size_t name_end = name_start;
+        while (name_end < text.size() && is_identifier_char(text[name_end])) name_end++;
+        if (name_end == name_start) continue;
+
+        // Anything other than an array definition, such as a pointer or a declaration, is skipped
+        pos = skip_space(text, name_end);
+        if (pos >= text.size() || text[pos] != '[') continue;
+        pos = text.find(']', pos);
+        if (pos == std::string_view::npos) break;
+        pos = skip_space(text, pos + 1);
+        if (pos >= text.size() || text[pos] != '=') continue;
+        pos = skip_space(text, pos + 1);
+        if (pos >= text.size() || text[pos] != '{') continue;
+
+        byte_array array{
+            .name = text.substr(name_start, name_end - name_start),
+            .bytes = {},
+        };
+
+        pos = parse_byte_list(text, pos + 1, array.bytes);
+        if (pos == std::string_view::npos) {
+            error = std::format("Malformed byte array {}", array.name);
+            return false;
+        }
+
+        arrays.push_back(std::move(array));
+    }
+
+    if (arrays.empty()) {
+        error = "No bytecode arrays found";
+        return false;
+    }
+
+    return true;
+}
+
+bool is_c_file(const std::string & filename) {
+    const std::string extension = std::filesystem::path(filename).extension().string();
+    return extension == ".c" || extension == ".h";
+}
+
+bool read_source(const std::string & filename, std::string & code, std::string & error) {
+    std::ifstream file;
+    file.open(filename);
+
+    if (!file.is_open()) {
+        error = "Failed to open file " + filename;
+        return false;
+    }
+
+    code = read_ifstream(&file);
+    file.close();
+    return true;
+}
+
+// Whether the code has an import or export declaration or uses import.meta, which only modules can. Comments and
+// string and template literals are skipped, and keywords used as property names or dynamic import() are not counted.
+// Regular expression literals are not told apart from division, so one containing a quote can hide what follows it.
+bool uses_module_syntax(const std::string_view code) {
+    const auto is_identifier_char = [](const char c) {
+        return std::isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '$' || static_cast<unsigned char>(c) >= 0x80;
+    };
+    const auto next_token = [&](size_t pos) {
+        while (pos < code.size() && std::isspace(static_cast<unsigned char>(code[pos]))) pos++;
+        return pos;
+    };
+
+    // Last character outside whitespace, comments and literals, to tell obj.import apart from import
+    char previous = 0;
+
+    for (size_t pos = 0; pos < code.size();) {
+        const char c = code[pos];
+
+        if (code.substr(pos, 2) == "//") {
+            pos = std::min(code.find('\n', pos), code.size());
+        } else if (code.substr(pos, 2) == "/*") {
+            const size_t end = code.find("*/", pos + 2);
+            pos = end == std::string_view::npos ? code.size() : end + 2;
+        } else if (c == '"' || c == '\'' || c == '`') {
+            pos++;
+            while (pos < code.size() && code[pos] != c) pos += code[pos] == '\\' ? 2 : 1;
+            pos++;
+            previous = c;
+        } else if (is_identifier_char(c)) {
+            const size_t start = pos;
+            while (pos < code.size() && is_identifier_char(code[pos])) pos++;
+            const std::string_view word = code.substr(start, pos - start);
+
+            if (previous != '.' && (word == "import" || word == "export")) {
+                const size_t next = next_token(pos);
+                const char follower = next < code.size() ? code[next] : 0;
+                if (word == "import" && follower == '.') {
+                    if (code.substr(next_token(next + 1), 4) == "meta") return true;
+                } else if (follower != ':' && follower != '(') {
+                    // Not a property name in an object literal, nor dynamic import(), which scripts can use
+                    return true;
+                }
+            }
+            previous = code[pos - 1];
+        } else {
+            if (!std::isspace(static_cast<unsigned char>(c))) previous = c;
+            pos++;
+        }
+    }
+
+    return false;
+}
+
+// Compiles source code as a script or module without running it. Returns JS_EXCEPTION and sets error on failure.
+// Automatic detection does not follow JS_DetectModule, which accepts nearly any script as a module: code is
+// compiled as a script unless it is in a .mjs file or uses module syntax. Outside .mjs and .cjs files, code which
+// fails to compile as one is tried as the other, such as a script using top-level await, and the error of the
+// first attempt is kept if both fail.
+JSValue compile_source(JSContext * ctx, const std::string & filename, const std::string & code, const source_type type,
+                       std::string & error) {
+    const std::string extension = std::filesystem::path(filename).extension().string();
+    const bool automatic = type == source_type::automatic;
+
+    const bool module = type == source_type::module
+        || (automatic && (extension == ".mjs" || (extension != ".cjs" && uses_module_syntax(code))));
+    const bool fallback = automatic && extension != ".mjs" && extension != ".cjs";
+
+    const auto compile = [&](const bool as_module) {
+        return JS_Eval(ctx, code.c_str(), code.length(), filename.c_str(),
+                       (as_module ? JS_EVAL_TYPE_MODULE : JS_EVAL_TYPE_GLOBAL) | JS_EVAL_FLAG_COMPILE_ONLY);
+    };
+
+    const JSValue obj = compile(module);
+    if (!JS_IsException(obj)) {
+        return obj;
+    }
+
+    error = take_exception(ctx);
+    if (!fallback) {
+        return obj;
+    }
+
+    const JSValue other = compile(!module);
+    if (JS_IsException(other)) {
+        JS_FreeValue(ctx, JS_GetException(ctx));
+    } else {
+        error.clear();
+    }
+    return other;
+}
+
+// Compiling a module resolves its imports right away. Only each file's own bytecode is disassembled, so
+// imports resolve to an empty module instead of loading and compiling the files they name.
+JSModuleDef * empty_module_loader(JSContext * ctx, const char * module_name, void *) {
+    return JS_NewCModule(ctx, module_name, [](JSContext *, JSModuleDef *) { return 0; });
+}
+
+// A context for a single file. Modules stay registered with the context that compiled or loaded them
+// until it is freed, so over a batch they would pile up in a worker's long-lived context.
+class file_context {
+public:
+    explicit file_context(JSContext * worker_ctx) : ctx(JS_NewContext(JS_GetRuntime(worker_ctx))) {}
+    ~file_context() {
+        if (ctx != nullptr) JS_FreeContext(ctx);
+    }
+
+    file_context(const file_context &) = delete;
+    file_context & operator=(const file_context &) = delete;
+
+    // nullptr if the context could not be created
+    JSContext * get() const { return ctx; }
+
+private:
+    JSContext * ctx;
+};
+
+// Loads the bytecode an earlier run compiled the source to, or compiles it and stores its bytecode for later runs.
+// Returns JS_EXCEPTION and sets error on failure.
+JSValue compile_cached(JSContext * ctx, const std::string & filename, const std::string & code,
+                       const disassembly_options & options, const uint64_t key, std::string & error) {
+    mapped_file entry;
+    std::string_view bytecode;
+
+    if (options.cache->load(key, "qbc", entry, bytecode)) {
+        const JSValue obj = JS_ReadObject(ctx, reinterpret_cast<const uint8_t *>(bytecode.data()), bytecode.size(),
+                                          JS_READ_OBJ_BYTECODE);
+        if (!JS_IsException(obj)) {
+            return obj;
+        }
+        // An entry the engine rejects is replaced by compiling the source again
+        JS_FreeValue(ctx, JS_GetException(ctx));
+    }
+
+    const JSValue obj = compile_source(ctx, filename, code, options.source, error);
+    if (JS_IsException(obj)) {
+        return obj;
+    }
+
+    size_t size;
+    uint8_t * data = JS_WriteObject(ctx, &size, obj, JS_WRITE_OBJ_BYTECODE);
+    if (data != nullptr) {
+        options.cache->store(key, "qbc", {reinterpret_cast<const char *>(data), size});
+        js_free(ctx, data);
+    }
+
+    return obj;
+}
+
+// Compiles and disassembles the code of one source file into out. Files which may be modules get a context of
+// their own; scripts are compiled in the worker's context. With a cache key, the bytecode is loaded from or stored
+// in the cache instead of only being compiled.
+bool disassemble_source(JSContext * ctx, const std::string & filename, const std::string & code,
+                        const disassembly_options & options, output_writer & out, file_result & result,
+                        const std::optional<uint64_t> key = std::nullopt) {
+    std::optional<file_context> module_ctx;
+    if (options.source != source_type::script) {
+        ctx = module_ctx.emplace(ctx).get();
+        if (ctx == nullptr) {
+            result.error = "Failed to create a context for " + filename;
+            return false;
+        }
+    }
+
+    const JSValue obj = key.has_value()
+        ? compile_cached(ctx, filename, code, options, *key, result.error)
+        : compile_source(ctx, filename, code, options.source, result.error);
+    if (JS_IsException(obj)) {
+        return false;
+    }
+
+    const bool success = dump_object(ctx, obj, filename, options, out, result, code);
+    JS_FreeValue(ctx, obj);
+    return success;
+}
+
+// Disassembles a bytecode file without compiling anything. Raw bytecode is loaded straight from the
+// mapped file; qjsc generated C files are parsed for their arrays, each of which is disassembled in turn.
+bool disassemble_bytecode(JSContext * worker_ctx, const std::string & filename, const disassembly_options & options,
+                          output_writer & out, file_result & result) {
+    mapped_file file;
+    if (!file.open(filename, result.error)) {
+        return false;
+    }
+
+    // Whether the bytecode holds a module is only known once it has been read
+    const file_context file_ctx(worker_ctx);
+    JSContext * ctx = file_ctx.get();
+    if (ctx == nullptr) {
+        result.error = "Failed to create a context for " + filename;
+        return false;
+    }
+
+    if (!is_c_file(filename)) {
+        if (!dump_serialized(ctx, file.data(), file.size(), filename, options, out, result)) {
+            result.error = filename + ": " + result.error;
+            return false;
+        }
+        return true;
+    }
+
+    std::vector<byte_array> arrays;
+    if (!parse_c_arrays(file.text(), arrays, result.error)) {
+        result.error = filename + ": " + result.error;
+        return false;
+    }
+
+    for (const auto & array : arrays) {
+        // JSON records name the array along with the file instead of using a header
+        const std::string name = options.format == output_format::json
+            ? std::format("{}:{}", filename, array.name)
+            : filename;
+
+        if (arrays.size() > 1 && options.format == output_format::text) {
+            out.format("Array: {}\n", array.name);
+        }
+
+        if (!dump_serialized(ctx, array.bytes.data(), array.bytes.size(), name, options, out, result)) {
+            result.error = std::format("{}: {}: {}", filename, array.name, result.error);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool disassemble_file(JSContext * ctx, const std::string & filename, const disassembly_options & options,
+                      output_writer & out, file_result & result) {
+    if (options.bytecode) {
+        return disassemble_bytecode(ctx, filename, options, out, result);
+    }
+
+    std::string code;
+    return read_source(filename, code, result.error)
+        && disassemble_source(ctx, filename, code, options, out, result);
+}
+
+// Key of a file's compiled bytecode: the input itself, how it is compiled, and the sources of the tools and engine
+// that compiled it, so any change to them invalidates the cache. The filename is part of the key because the
+// bytecode records it.
+uint64_t input_key(const std::string & filename, const std::string_view contents, const disassembly_options & options) {
+    return content_hash()
+        .add(QUICKJS_TOOLS_SOURCE_HASH)
+        .add(JS_GetVersion())
+        .add(filename)
+        .add_value(options.bytecode)
+        .add_value(options.source)
+        .add(contents)
+        .value();
+}
+
+// Key of a file's rendered result, which also depends on what is rendered
+uint64_t result_key(const uint64_t input, const disassembly_options & options) {
+    return content_hash()
+        .add_value(input)
+        .add_value(options.strip)
+        .add_value(options.format)
+        .add_value(options.control_flow)
+        .add_value(options.positions)
+        .add_value(options.interleave)
+        .add_value(options.polls)
+        .add_value(options.report)
+        .value();
+}
+
+void put_footprint(record_writer & writer, const memory_footprint & footprint) {
+    writer.put(footprint.functions);
+    writer.put(footprint.header);
+    writer.put(footprint.bytecode);
+    writer.put(footprint.cpool);
+    writer.put(footprint.vardefs);
+    writer.put(footprint.closure_vars);
+    writer.put(footprint.pc2line);
+    writer.put(footprint.source);
+    writer.put(footprint.serialized);
+}
+
+bool get_footprint(record_reader & reader, memory_footprint & footprint) {
+    return reader.get(footprint.functions) && reader.get(footprint.header) && reader.get(footprint.bytecode)
+        && reader.get(footprint.cpool) && reader.get(footprint.vardefs) && reader.get(footprint.closure_vars)
+        && reader.get(footprint.pc2line) && reader.get(footprint.source) && reader.get(footprint.serialized);
+}
+
+std::string serialize_result(const file_result & result) {
+    record_writer writer;
+
+    writer.put(static_cast<uint64_t>(result.frames.size()));
+    for (const auto & frame : result.frames) {
+        writer.put_string(frame.function);
+        writer.put_string(frame.filename);
+        writer.put(frame.line);
+        writer.put(frame.frame_size);
+        writer.put(frame.arg_count);
+        writer.put(frame.var_count);
+        writer.put(frame.stack_size);
+    }
+
+    writer.put(result.stack_failures);
+
+    writer.put(result.stats.functions);
+    writer.put(result.stats.instructions);
+    writer.put(result.stats.bytes);
+    writer.put(result.stats.opcodes);
+    writer.put(result.stats.formats);
+    writer.put(result.stats.sizes);
+
+    for (const auto & footprint : result.memory) put_footprint(writer, footprint);
+
+    writer.put(result.short_forms.functions);
+    writer.put(result.short_forms.bytes);
+    writer.put(result.short_forms.missed);
+    writer.put(result.short_forms.saved);
+
+    writer.put(result.lint);
+
+    writer.put(static_cast<uint64_t>(result.poll_gaps.size()));
+    for (const auto & gap : result.poll_gaps) {
+        writer.put_string(gap.function);
+        writer.put_string(gap.filename);
+        writer.put(gap.line);
+        writer.put(gap.stretch.start);
+        writer.put(gap.stretch.end);
+        writer.put(gap.stretch.instruction_count);
+    }
+    writer.put(result.unbounded_polls);
+
+    writer.put_string(result.output);
+    return writer.take();
+}
+
+bool deserialize_result(const std::string_view data, file_result & result) {
+    record_reader reader(data);
+
+    uint64_t frame_count;
+    if (!reader.get(frame_count)) return false;
+
+    for (uint64_t i = 0; i < frame_count; i++) {
+        frame_entry & frame = result.frames.emplace_back();
+        if (!reader.get_string(frame.function) || !reader.get_string(frame.filename) || !reader.get(frame.line)
+            || !reader.get(frame.frame_size) || !reader.get(frame.arg_count) || !reader.get(frame.var_count)
+            || !reader.get(frame.stack_size)) {
+            return false;
+        }
+    }
+
+    if (!reader.get(result.stack_failures)) return false;
+
+    if (!reader.get(result.stats.functions) || !reader.get(result.stats.instructions) || !reader.get(result.stats.bytes)
+        || !reader.get(result.stats.opcodes) || !reader.get(result.stats.formats) || !reader.get(result.stats.sizes)) {
+        return false;
+    }
+
+    for (auto & footprint : result.memory) {
+        if (!get_footprint(reader, footprint)) return false;
+    }
+
+    if (!reader.get(result.short_forms.functions) || !reader.get(result.short_forms.bytes)
+        || !reader.get(result.short_forms.missed) || !reader.get(result.short_forms.saved) || !reader.get(result.lint)) {
+        return false;
+    }
+
+    uint64_t gap_count;
+    if (!reader.get(gap_count)) return false;
+
+    for (uint64_t i = 0; i < gap_count; i++) {
+        poll_gap_entry & gap = result.poll_gaps.emplace_back();
+        if (!reader.get_string(gap.function) || !reader.get_string(gap.filename) || !reader.get(gap.line)
+            || !reader.get(gap.stretch.start) || !reader.get(gap.stretch.end)
+            || !reader.get(gap.stretch.instruction_count)) {
+            return false;
+        }
+    }
+
+    return reader.get(result.unbounded_polls) && reader.get_string(result.output) && reader.finished();
+}
+
+// Disassembles one file into an in-memory buffer using the worker's context
+file_result disassemble_file(JSContext * ctx, const std::string & filename, const disassembly_options & options) {
+    file_result result;
+    output_writer out;
+
+    if (options.cache == nullptr) {
+        if (disassemble_file(ctx, filename, options, out, result)) {
+            result.output = out.take();
+        }
+        return result;
+    }
+
+    // Unchanged files are not compiled or rendered again: their result is read back from the cache
+    mapped_file bytecode;
+    std::string code;
+    if (options.bytecode ? !bytecode.open(filename, result.error) : !read_source(filename, code, result.error)) {
+        return result;
+    }
+
+    const uint64_t input = input_key(filename, options.bytecode ? bytecode.text() : code, options);
+    const uint64_t key = result_key(input, options);
+
+    mapped_file entry;
+    std::string_view cached;
+    if (options.cache->load(key, "result", entry, cached) && deserialize_result(cached, result)) {
+        return result;
+    }
+    result = file_result{};
+
+    const bool success = options.bytecode
+        ? disassemble_bytecode(ctx, filename, options, out, result)
+        : disassemble_source(ctx, filename, code, options, out, result, input);
+
+    if (success) {
+        result.output = out.take();
+        options.cache->store(key, "result", serialize_result(result));
+    }
+
+    return result;
+}
+
+// Loads one side of a --diff as a script or module. Returns JS_EXCEPTION and sets error on failure.
+JSValue load_script(JSContext * ctx, const std::string & filename, const disassembly_options & options,
+                    std::string & error) {
+    JSValue obj;
+
+    if (!options.bytecode) {
+        std::string code;
+        if (!read_source(filename, code, error)) {
+            return JS_EXCEPTION;
+        }
+        obj = compile_source(ctx, filename, code, options.source, error);
+    } else {
+        mapped_file file;
+        if (!file.open(filename, error)) {
+            return JS_EXCEPTION;
+        }
+
+        std::vector<byte_array> arrays;
+        const uint8_t * data = file.data();
+        size_t size = file.size();
+
+        if (is_c_file(filename)) {
+            if (!parse_c_arrays(file.text(), arrays, error)) {
+                error = filename + ": " + error;
+                return JS_EXCEPTION;
+            }
+            if (arrays.size() != 1) {
+                error = std::format("{}: Contains {} bytecode arrays, only files with one can be compared", filename, arrays.size());
+                return JS_EXCEPTION;
+            }
+            data = arrays[0].bytes.data();
+            size = arrays[0].bytes.size();
+        }
+
+        obj = JS_ReadObject(ctx, data, size, JS_READ_OBJ_BYTECODE);
+        if (JS_IsException(obj)) {
+            error = filename + ": " + take_exception(ctx);
+        }
+    }
+
+    if (JS_IsException(obj)) {
+        return obj;
+    }
+
+    error = unsupported_object(obj);
+    if (!error.empty()) {
+        error = filename + ": " + error;
+        JS_FreeValue(ctx, obj);
+        return JS_EXCEPTION;
+    }
+
+    return obj;
+}
+
+// A function of one side of a --diff
+struct diff_function {
+    const JSFunctionBytecode * b;
     std::string name;
-    size_t size;
-};
 
-instruction instructions[] = {
-#define DEF(ID, SIZE, N_POP, N_PUSH, F) \
-    {                                   \
-        .name = #ID,                    \
-        .size = SIZE                    \
-    },
-#define def(id, size, n_pop, n_push, f)
-#include "quickjs-opcode.h"
+    // Each instruction as disassembled, and as compared. Jump targets move whenever the code before
+    // them changes and variable slots whenever a variable is added, so variables are compared by name
+    // and jump targets not at all.
+    std::vector<std::string> text;
+    std::vector<std::string> keys;
+    std::vector<uint32_t> offsets;
+
+    uint32_t short_opcodes = 0;
+    // Names read with get_var and get_var_undef, which look the variable up in the global object
+    std::map<std::string, uint32_t> globals;
+    uint32_t global_lookups = 0;
 };
 
-constexpr int INDENT_WIDTH = 2;
+diff_function describe_function(dump_context & dc, const JSFunctionBytecode * b) {
+    diff_function function{
+        .b = b,
+        .name = std::string(function_name(dc, b)),
+    };
 
-void dump_bytecode(const JSFunctionBytecode * b, const bool strip, const int indent) {
-    uint8_t * bytecode = b->byte_code_buf;
-    const size_t bytecode_len = b->byte_code_len;
+    output_writer text;
+    output_writer * const previous_out = dc.out;
+    dc.out = &text;
+
+    for (uint32_t pos = 0; pos < static_cast<uint32_t>(b->byte_code_len);) {
+        const decoded_instruction insn = decode_instruction(b, pos);
+        const instruction & info = *insn.info;
 
-    if (b->source_len > 0 && !strip) {
-        // Log source
-        std::cout << std::string(indent * INDENT_WIDTH, ' ') << "Source (Line " << b->line_num << "):" << std::endl
-            << std::string((indent + 1) * INDENT_WIDTH, ' ');
+        text.write(info.name);
+        write_operands(dc, b, insn);
+        function.text.push_back(text.take());
 
-        for (size_t i = 0; i < b->source_len; i++) {
-            const char character = b->source[i];
-            std::cout << character;
-            if (character == '\n') {
-                std::cout << std::string((indent + 1) * INDENT_WIDTH, ' ');
+        text.write(info.name);
+        for (int i = 0; i < insn.operand_count; i++) {
+            text.write(i == 0 ? " " : ", ");
+            const std::string * name = variable_name(dc, b, insn.operands[i]);
+            if (insn.operands[i].kind == operand_label) {
+                text.write("->");
+            } else if (name != nullptr) {
+                text.write(*name);
+            } else {
+                write_operand(dc, b, insn.operands[i]);
             }
         }
+        function.keys.push_back(text.take());
+        function.offsets.push_back(pos);
+
+        if (is_short_opcode(info.id)) {
+            function.short_opcodes++;
+        }
 
-        std::cout << std::endl;
+        if (info.id == op_get_var || info.id == op_get_var_undef) {
+            function.globals[atom_name(dc, static_cast<JSAtom>(insn.operands[0].value))]++;
+            function.global_lookups++;
+        }
+
+        pos += info.size;
     }
 
-    size_t i = 0;
+    dc.out = previous_out;
+    return function;
+}
 
-    while (i < bytecode_len) {
-        auto [name, size] = instructions[bytecode[i]];
-        const size_t args = size - 1;
+std::vector<diff_function> describe_functions(dump_context & dc, const JSValue obj) {
+    std::vector<diff_function> functions;
+    walk_functions(dc, top_level_function(obj),
+                   [&](dump_context & context, const JSFunctionBytecode * b) {
+                       functions.push_back(describe_function(context, b));
+                   });
+    return functions;
+}
+
+// Pairs each new function with an old one of the same name and line, then pairs the rest by name alone,
+// in order of appearance. Unpaired functions are NO_MATCH on the side they are missing from.
+constexpr size_t NO_MATCH = SIZE_MAX;
+
+std::vector<size_t> match_functions(const std::vector<diff_function> & old_functions,
+                                    const std::vector<diff_function> & new_functions) {
+    std::unordered_map<std::string_view, std::vector<size_t>> by_name;
+    for (size_t i = 0; i < old_functions.size(); i++) {
+        by_name[old_functions[i].name].push_back(i);
+    }
+
+    std::vector<size_t> matches(new_functions.size(), NO_MATCH);
+    std::vector<bool> used(old_functions.size(), false);
+
+    auto match = [&](const bool same_line) {
+        for (size_t i = 0; i < new_functions.size(); i++) {
+            if (matches[i] != NO_MATCH) continue;
+
+            const auto it = by_name.find(new_functions[i].name);
+            if (it == by_name.end()) continue;
 
-        std::cout << std::string(indent * INDENT_WIDTH, ' ') << std::format("{:#04x}", bytecode[i])
-            << " (" << name << ") ";
+            for (const size_t candidate : it->second) {
+                if (used[candidate]) continue;
+                if (same_line && old_functions[candidate].b->line_num != new_functions[i].b->line_num) continue;
 
-        for (size_t arg = 1; arg <= args; arg++) {
-            std::cout << std::format("{:#04x}", bytecode[i+arg]) << " ";
+                matches[i] = candidate;
+                used[candidate] = true;
+                break;
+            }
         }
+    };
 
-        std::cout << std::endl;
+    match(true);
+    match(false);
+    return matches;
+}
 
-        if (name == "fclosure8") {
-            const uint8_t loc = bytecode[i+1];
-            const auto * closure_bytecode = static_cast<JSFunctionBytecode *>(JS_VALUE_GET_PTR(b->cpool[loc]));
-            dump_bytecode(closure_bytecode, strip, indent + 1);
-        } else if (name == "fclosure") {
-            uint32_t loc;
-            memcpy(&loc, bytecode + i + 1, sizeof(loc));
-            const auto * closure_bytecode = static_cast<JSFunctionBytecode *>(JS_VALUE_GET_PTR(b->cpool[loc]));
-            dump_bytecode(closure_bytecode, strip, indent + 1);
+std::string change(const int64_t before, const int64_t after) {
+    if (before == after) return std::format("{}", after);
+    return std::format("{} -> {} ({:+})", before, after, after - before);
+}
+
+// Writes the changed instructions of a pair of functions with a few unchanged ones around them
+void write_instruction_diff(output_writer & out, const diff_function & old_function, const diff_function & new_function) {
+    constexpr size_t CONTEXT = 2;
+
+    const std::vector<edit> edits = diff_sequences(old_function.keys, new_function.keys);
+
+    std::vector<bool> shown(edits.size(), false);
+    for (size_t i = 0; i < edits.size(); i++) {
+        if (edits[i].kind == edit_kind::keep) continue;
+        const size_t first = i > CONTEXT ? i - CONTEXT : 0;
+        const size_t last = std::min(i + CONTEXT, edits.size() - 1);
+        for (size_t j = first; j <= last; j++) shown[j] = true;
+    }
+
+    bool skipped = false;
+    for (size_t i = 0; i < edits.size(); i++) {
+        if (!shown[i]) {
+            skipped = true;
+            continue;
+        }
+
+        if (skipped) {
+            out.indent(1);
+            out.write("...\n");
+            skipped = false;
+        }
+
+        const edit & e = edits[i];
+        out.indent(1);
+        if (e.kind == edit_kind::remove) {
+            out.format("-{:5}: {}\n", old_function.offsets[e.old_index], old_function.text[e.old_index]);
+        } else {
+            const char marker = e.kind == edit_kind::insert ? '+' : ' ';
+            out.format("{}{:5}: {}\n", marker, new_function.offsets[e.new_index], new_function.text[e.new_index]);
+        }
+    }
+}
+
+// Names read from the global object by the new function but not by the old one
+std::vector<std::string_view> new_globals(const diff_function & old_function, const diff_function & new_function) {
+    std::vector<std::string_view> names;
+    for (const auto & [name, count] : new_function.globals) {
+        if (!old_function.globals.contains(name)) names.push_back(name);
+    }
+    return names;
+}
+
+void write_function_summary(output_writer & out, const std::string_view label, const diff_function & function) {
+    out.format("{} function {} (line {}): {} instructions, {} bytes, stack_size {}, {} global lookup(s)\n",
+               label, function.name, function.b->line_num, function.keys.size(), function.b->byte_code_len,
+               function.b->stack_size, function.global_lookups);
+}
+
+// Writes how every function changed between two versions of a script. A function regresses when its
+// bytecode or stack grows or it reads a global it did not read before; returns false if any did.
+bool write_diff(dump_context & old_dc, dump_context & new_dc, const JSValue old_obj, const JSValue new_obj,
+                output_writer & out) {
+    const std::vector<diff_function> old_functions = describe_functions(old_dc, old_obj);
+    const std::vector<diff_function> new_functions = describe_functions(new_dc, new_obj);
+    const std::vector<size_t> matches = match_functions(old_functions, new_functions);
+
+    out.format("--- {}\n+++ {}\n", old_dc.filename, new_dc.filename);
+
+    size_t changed = 0;
+    size_t added = 0;
+    size_t regressions = 0;
+    std::vector<bool> matched(old_functions.size(), false);
+
+    for (size_t i = 0; i < new_functions.size(); i++) {
+        const diff_function & new_function = new_functions[i];
+
+        if (matches[i] == NO_MATCH) {
+            write_function_summary(out, "Added", new_function);
+            added++;
+            continue;
+        }
+
+        const diff_function & old_function = old_functions[matches[i]];
+        const JSFunctionBytecode * old_b = old_function.b;
+        const JSFunctionBytecode * new_b = new_function.b;
+        matched[matches[i]] = true;
+
+        if (old_function.keys == new_function.keys && old_b->stack_size == new_b->stack_size
+            && frame_size(old_b) == frame_size(new_b)) {
+            continue;
+        }
+
+        changed++;
+
+        const std::vector<std::string_view> globals = new_globals(old_function, new_function);
+        const bool regressed = new_b->byte_code_len > old_b->byte_code_len || new_b->stack_size > old_b->stack_size
+            || !globals.empty();
+        if (regressed) regressions++;
+
+        out.format("Function {} (line {}){}: instructions {}, bytes {}, stack_size {}, frame {}, short opcodes {}, global lookups {}\n",
+                   new_function.name, change(old_b->line_num, new_b->line_num), regressed ? " regressed" : "",
+                   change(static_cast<int64_t>(old_function.keys.size()), static_cast<int64_t>(new_function.keys.size())),
+                   change(old_b->byte_code_len, new_b->byte_code_len), change(old_b->stack_size, new_b->stack_size),
+                   change(frame_size(old_b), frame_size(new_b)),
+                   change(old_function.short_opcodes, new_function.short_opcodes),
+                   change(old_function.global_lookups, new_function.global_lookups));
+
+        if (!globals.empty()) {
+            out.indent(1);
+            out.write("New global lookups:");
+            for (size_t j = 0; j < globals.size(); j++) {
+                out.format("{}{}", j == 0 ? " " : ", ", globals[j]);
+            }
+            out.newline();
         }
 
-        i += size;
+        write_instruction_diff(out, old_function, new_function);
+    }
+
+    size_t removed = 0;
+    for (size_t i = 0; i < old_functions.size(); i++) {
+        if (matched[i]) continue;
+        write_function_summary(out, "Removed", old_functions[i]);
+        removed++;
+    }
+
+    auto total = [](const std::vector<diff_function> & functions, auto field) {
+        int64_t sum = 0;
+        for (const auto & function : functions) sum += field(function);
+        return sum;
+    };
+    auto instruction_count = [](const diff_function & f) { return static_cast<int64_t>(f.keys.size()); };
+    auto bytes = [](const diff_function & f) { return static_cast<int64_t>(f.b->byte_code_len); };
+    auto short_opcodes = [](const diff_function & f) { return static_cast<int64_t>(f.short_opcodes); };
+    auto global_lookups = [](const diff_function & f) { return static_cast<int64_t>(f.global_lookups); };
+
+    out.format("{} function(s) changed, {} added, {} removed, {} regressed; instructions {}, bytes {}, "
+               "short opcodes {}, global lookups {}\n",
+               changed, added, removed, regressions,
+               change(total(old_functions, instruction_count), total(new_functions, instruction_count)),
+               change(total(old_functions, bytes), total(new_functions, bytes)),
+               change(total(old_functions, short_opcodes), total(new_functions, short_opcodes)),
+               change(total(old_functions, global_lookups), total(new_functions, global_lookups)));
+
+    return regressions == 0;
+}
+
+// Compares two versions of a script. Returns false if either cannot be loaded or a function regressed.
+bool diff_files(const std::string & old_filename, const std::string & new_filename,
+                const disassembly_options & options, output_writer & out) {
+    JSRuntime* rt = JS_NewRuntime();
+    JS_SetModuleLoaderFunc(rt, nullptr, empty_module_loader, nullptr);
+    JSContext* ctx = JS_NewContext(rt);
+    js_std_add_helpers(ctx, 0, nullptr);
+
+    file_result result;
+    bool success = false;
+
+    const JSValue old_obj = load_script(ctx, old_filename, options, result.error);
+    const JSValue new_obj = JS_IsException(old_obj) ? JS_EXCEPTION : load_script(ctx, new_filename, options, result.error);
+
+    if (!JS_IsException(new_obj)) {
+        auto context_for = [&](const std::string & filename) {
+            return dump_context{
+                .ctx = ctx,
+                .out = &out,
+                .options = &options,
+                .filename = filename,
+                .result = &result,
+                .path = {},
+                .visited = {},
+                .atom_names = {},
+                .source_lines = {},
+            };
+        };
+
+        dump_context old_dc = context_for(old_filename);
+        dump_context new_dc = context_for(new_filename);
+        success = write_diff(old_dc, new_dc, old_obj, new_obj, out);
+    } else {
+        std::cerr << result.error << std::endl;
+    }
+
+    JS_FreeValue(ctx, old_obj);
+    JS_FreeValue(ctx, new_obj);
+    JS_FreeContext(ctx);
+    JS_FreeRuntime(rt);
+    return success;
+}
+
+// Lists the longest stretches without an interrupt poll, longest first
+void write_poll_gap_ranking(output_writer & out, std::vector<poll_gap_entry> & gaps, const size_t count) {
+    std::stable_sort(gaps.begin(), gaps.end(), [](const poll_gap_entry & a, const poll_gap_entry & b) {
+        return a.stretch.instruction_count > b.stretch.instruction_count;
+    });
+
+    out.write("Longest stretches without a poll:\n");
+
+    for (size_t i = 0; i < std::min(count, gaps.size()); i++) {
+        const poll_gap_entry & gap = gaps[i];
+        out.format("{:4}. {} instruction(s): {} ({}:{}) at {}-{}\n",
+                   i + 1, gap.stretch.instruction_count, gap.function, gap.filename, gap.line,
+                   gap.stretch.start, gap.stretch.end);
+    }
+}
+
+// Lists the functions with the largest frames, largest first
+void write_frame_ranking(output_writer & out, std::vector<frame_entry> & frames, const size_t count) {
+    std::stable_sort(frames.begin(), frames.end(), [](const frame_entry & a, const frame_entry & b) {
+        return a.frame_size > b.frame_size;
+    });
+
+    out.write("Largest frames:\n");
+
+    for (size_t i = 0; i < std::min(count, frames.size()); i++) {
+        const frame_entry & frame = frames[i];
+        out.format("{:4}. {} bytes: {} ({}:{}), {} arg(s), {} var(s), stack_size {}\n",
+                   i + 1, frame.frame_size, frame.function, frame.filename, frame.line,
+                   frame.arg_count, frame.var_count, frame.stack_size);
     }
 }
 
-void dump_bytecode(const JSFunctionBytecode * b, const bool strip) {
-    dump_bytecode(b, strip, 0);
+std::string_view output_extension(const output_format format) {
+    switch (format) {
+        case output_format::json: return ".ndjson";
+        case output_format::dot: return ".dot";
+        case output_format::text: break;
+    }
+    return ".txt";
+}
+
+// Path of the per-file output for an input inside the output directory
+std::filesystem::path output_path_for(const std::string & output_dir, const std::string & filename,
+                                      const std::string_view extension) {
+    std::filesystem::path relative;
+
+    // Keep the input's directory structure, minus any root or parent directory components
+    for (const auto & component : std::filesystem::path(filename).lexically_normal().relative_path()) {
+        if (component != "..") relative /= component;
+    }
+
+    return std::filesystem::path(output_dir) / (relative.string() + std::string(extension));
+}
+
+bool write_file(const std::filesystem::path & path, const std::string & contents) {
+    std::error_code error;
+    std::filesystem::create_directories(path.parent_path(), error);
+
+    FILE * file = fopen(path.string().c_str(), "wb");
+    if (file == nullptr) return false;
+
+    bool success;
+    {
+        output_writer out(file);
+        out.write(contents);
+        out.flush();
+        success = out.good();
+    }
+
+    return fclose(file) == 0 && success;
 }
 
 int main(const int argc, char * argv[]) {
     po::options_description desc("Allowed options");
     desc.add_options()
         ("help,h", "print help message")
-        ("file,f", po::value<std::string>(), "input file containing code")
+        ("file,f", po::value<std::vector<std::string>>(), "input file(s), directories or glob patterns containing code")
+        ("file-list", po::value<std::string>(), "file containing a list of inputs, one per line")
+        ("bytecode,b", "inputs are bytecode written by JS_WriteObject or qjsc -b, or C files generated by qjsc, instead of source code")
+        ("source-type", po::value<std::string>()->default_value("auto"), "compile source inputs as script or module, or auto to compile .mjs files and code with import or export declarations as modules")
+        ("output,o", po::value<std::string>(), "write the disassembly to a file instead of stdout")
+        ("output-dir", po::value<std::string>(), "write the disassembly of each input file to its own file in this directory")
+        ("cache-dir", po::value<std::string>(), "keep the compiled bytecode and results of each file in this directory, and reuse them for files which have not changed since")
+        ("jobs,j", po::value<unsigned int>(), "number of threads to use (default: number of cores)")
+        ("format", po::value<std::string>()->default_value("text"), "output format: text, json for one JSON record per line for each function and instruction, or dot for a Graphviz graph of each function's basic blocks")
+        ("cfg", "with text output, print the basic blocks and loops of each function")
+        ("lines", "with text output, tag each instruction with the line:col it was compiled from")
+        ("polls", "with text output, mark the instructions which poll for interrupts, and those which may when they call a function")
+        ("interleave", "with text output, print each source line before the instructions compiled from it instead of the whole source of each function")
+        ("stack", "instead of the disassembly, check the stack depth of each function against its stack_size and rank functions by frame size")
+        ("stats", "instead of the disassembly, count opcodes, operand formats and instruction sizes over all functions of all files")
+        ("memory", "instead of the disassembly, break down the memory held by each function and compare each file with its stripped variants")
+        ("short-forms", "instead of the disassembly, list the instructions encoded in a longer form than a compact one their operands fit, and the bytes the compact forms would save")
+        ("lint", "instead of the disassembly, list the instructions matching known slow patterns, such as global variable lookups and closures created in loops, with, direct eval and arguments, deepest loops first. The exit code is 1 if there are any")
+        ("poll-gaps", "instead of the disassembly, list the interrupt poll sites of each function and rank the longest stretches of instructions without a poll. The exit code is 1 if any loop can run without polling")
+        ("diff", "compare two versions of a script given as the two input files, function by function. The exit code is 1 if any function's bytecode or stack grew or it reads new globals")
+        ("top", po::value<unsigned int>()->default_value(20), "number of functions to list in rankings")
         ("strip,s", "strip source information");
+    po::positional_options_description positional;
+    positional.add("file", -1);
     po::variables_map vm;
     try {
-        po::store(po::parse_command_line(argc, argv, desc), vm);
+        po::store(po::command_line_parser(argc, argv).options(desc).positional(positional).run(), vm);
     }
-    catch (po::unknown_option& e) {
+    catch (po::error& e) {
         std::cerr << e.what() << std::endl;
         return 1;
     }
@@ -105,43 +1990,283 @@ int main(const int argc, char * argv[]) {
         return 1;
     }
 
-    if (!vm.contains("file")) {
+    std::vector<std::string> inputs;
+
+    if (vm.contains("file")) {
+        inputs = vm["file"].as<std::vector<std::string>>();
+    }
+
+    if (vm.contains("file-list") && !read_file_list(vm["file-list"].as<std::string>(), inputs)) {
+        return 1;
+    }
+
+    if (inputs.empty()) {
         std::cerr << "No input file provided with -f. Exiting." << std::endl;
         return 1;
     }
 
-    std::string filename = vm["file"].as<std::string>();
-    std::ifstream file;
-    file.open(filename);
+    if (vm.contains("output") && vm.contains("output-dir")) {
+        std::cerr << "-o and --output-dir cannot be combined. Exiting." << std::endl;
+        return 1;
+    }
 
-    if (!file.is_open()) {
-        std::cerr << "Failed to open file " << filename << std::endl;
+    output_format format;
+    const std::string format_name = vm["format"].as<std::string>();
+
+    if (format_name == "text") {
+        format = output_format::text;
+    } else if (format_name == "json") {
+        format = output_format::json;
+    } else if (format_name == "dot") {
+        format = output_format::dot;
+    } else {
+        std::cerr << "Unknown output format " << format_name << ". Exiting." << std::endl;
         return 1;
     }
 
-    std::string code = read_ifstream(&file);
-    file.close();
+    source_type source;
+    const std::string source_type_name = vm["source-type"].as<std::string>();
 
-    JSRuntime* rt = JS_NewRuntime();
-    JSContext* ctx = JS_NewContext(rt);
-    js_std_add_helpers(ctx, 0, nullptr);
+    if (source_type_name == "auto") {
+        source = source_type::automatic;
+    } else if (source_type_name == "script") {
+        source = source_type::script;
+    } else if (source_type_name == "module") {
+        source = source_type::module;
+    } else {
+        std::cerr << "Unknown source type " << source_type_name << ". Exiting." << std::endl;
+        return 1;
+    }
 
-    const JSValue obj = JS_Eval(ctx, code.c_str(), code.length(), filename.c_str(), JS_EVAL_TYPE_GLOBAL | JS_EVAL_FLAG_COMPILE_ONLY);
-    if (JS_IsException(obj)) {
-        js_std_dump_error(ctx);
-        JS_FreeValue(ctx, obj);
-        JS_FreeContext(ctx);
-        JS_FreeRuntime(rt);
+    if (vm.contains("stack") + vm.contains("stats") + vm.contains("memory") + vm.contains("diff")
+        + vm.contains("short-forms") + vm.contains("lint") + vm.contains("poll-gaps") > 1) {
+        std::cerr << "--stack, --stats, --memory, --diff, --short-forms, --lint and --poll-gaps cannot be combined. Exiting."
+                  << std::endl;
         return 1;
     }
 
-    auto * b = static_cast<JSFunctionBytecode *>(JS_VALUE_GET_PTR(obj));
+    report_kind report = report_kind::disassembly;
+    if (vm.contains("stack")) report = report_kind::stack;
+    if (vm.contains("stats")) report = report_kind::stats;
+    if (vm.contains("memory")) report = report_kind::memory;
+    if (vm.contains("diff")) report = report_kind::diff;
+    if (vm.contains("short-forms")) report = report_kind::short_forms;
+    if (vm.contains("lint")) report = report_kind::lint;
+    if (vm.contains("poll-gaps")) report = report_kind::poll_gaps;
 
-    dump_bytecode(b, vm.contains("strip"));
+    std::optional<content_cache> cache;
+    if (vm.contains("cache-dir") && report != report_kind::diff) {
+        cache.emplace(vm["cache-dir"].as<std::string>());
+    }
 
-    JS_FreeValue(ctx, obj);
-    JS_FreeContext(ctx);
-    JS_FreeRuntime(rt);
+    const disassembly_options options{
+        .bytecode = vm.contains("bytecode"),
+        .source = source,
+        .strip = vm.contains("strip"),
+        .format = format,
+        .control_flow = vm.contains("cfg"),
+        .positions = vm.contains("lines"),
+        .interleave = vm.contains("interleave"),
+        .polls = vm.contains("polls"),
+        .report = report,
+        .cache = cache.has_value() ? &*cache : nullptr,
+    };
+
+    if ((options.control_flow || options.positions || options.interleave || options.polls
+         || report == report_kind::stack || report == report_kind::memory || report == report_kind::diff
+         || report == report_kind::short_forms || report == report_kind::lint || report == report_kind::poll_gaps)
+        && format != output_format::text) {
+        std::cerr << "--cfg, --lines, --interleave, --polls, --stack, --memory, --diff, --short-forms, --lint and --poll-gaps"
+                  << " can only be used with text output. Exiting." << std::endl;
+        return 1;
+    }
+
+    if (report == report_kind::stats && format == output_format::dot) {
+        std::cerr << "--stats can only be used with text or json output. Exiting." << std::endl;
+        return 1;
+    }
+
+    if (report == report_kind::stats && vm.contains("output-dir")) {
+        std::cerr << "--stats writes a single report and cannot be used with --output-dir. Exiting." << std::endl;
+        return 1;
+    }
+
+    std::vector<std::string> filenames;
+    const std::vector<std::string> extensions = options.bytecode
+        ? std::vector<std::string>{".bin", ".qbc", ".c"}
+        : std::vector<std::string>{".js", ".mjs", ".cjs"};
+
+    if (!collect_input_files(inputs, extensions, filenames)) {
+        return 1;
+    }
+
+    if (report == report_kind::diff && (inputs.size() != 2 || filenames.size() != 2 || vm.contains("output-dir"))) {
+        std::cerr << "--diff compares exactly two input files into a single output. Exiting." << std::endl;
+        return 1;
+    }
+
+    const bool per_file_output = vm.contains("output-dir");
+    // A header separates the files when several are merged into one text output; JSON records name their file
+    // and --stats only writes totals
+    const bool print_headers = filenames.size() > 1 && !per_file_output && format == output_format::text
+        && report != report_kind::stats;
+    unsigned int num_threads = vm.contains("jobs") ? vm["jobs"].as<unsigned int>() : default_thread_count();
+    num_threads = std::clamp<unsigned int>(num_threads, 1, std::max<size_t>(filenames.size(), 1));
+    // A single worker already finishes files in input order, so it writes straight to the output
+    // instead of holding each file's disassembly in memory, unless the disassembly is also cached
+    const bool stream_output = num_threads == 1 && !per_file_output && options.cache == nullptr;
+
+    FILE * output_file = stdout;
+
+    if (vm.contains("output")) {
+        const std::string output_filename = vm["output"].as<std::string>();
+        output_file = fopen(output_filename.c_str(), "wb");
+
+        if (output_file == nullptr) {
+            std::cerr << "Failed to open output file " << output_filename << std::endl;
+            return 1;
+        }
+    }
+
+    bool success = true;
+    bool write_ok;
+
+    std::vector<frame_entry> frames;
+    int stack_failures = 0;
+    opcode_stats stats;
+    variant_footprints memory{};
+    short_form_totals short_forms;
+    lint_counts lint{};
+    std::vector<poll_gap_entry> poll_gaps;
+    int unbounded_polls = 0;
+
+    // Gathers the data of a finished file needed for reports covering all files
+    auto collect = [&](file_result & result) {
+        if (!result.error.empty()) {
+            std::cerr << result.error << std::endl;
+            success = false;
+        }
+
+        std::move(result.frames.begin(), result.frames.end(), std::back_inserter(frames));
+        stack_failures += result.stack_failures;
+        stats += result.stats;
+        short_forms += result.short_forms;
+        for (size_t i = 0; i < lint.size(); i++) lint[i] += result.lint[i];
+        std::move(result.poll_gaps.begin(), result.poll_gaps.end(), std::back_inserter(poll_gaps));
+        unbounded_polls += result.unbounded_polls;
+        for (size_t i = 0; i < memory.size(); i++) memory[i] += result.memory[i];
+    };
+
+    {
+        output_writer out(output_file);
+
+        if (options.report == report_kind::diff) {
+            success = diff_files(filenames[0], filenames[1], options, out);
+        } else {
+            // Files finish in any order but are committed in input order, as soon as all earlier files are done
+            std::mutex commit_mutex;
+            std::vector<std::optional<file_result>> results(filenames.size());
+            size_t next_commit = 0;
+
+            auto commit = [&](const size_t index, file_result result) {
+                std::lock_guard lock(commit_mutex);
+                results[index] = std::move(result);
+
+                for (; next_commit < results.size() && results[next_commit].has_value(); next_commit++) {
+                    file_result & committed = *results[next_commit];
+                    const std::string & filename = filenames[next_commit];
+
+                    collect(committed);
+
+                    if (committed.error.empty() && per_file_output) {
+                        const auto path = output_path_for(vm["output-dir"].as<std::string>(), filename,
+                                                          output_extension(format));
+                        if (!write_file(path, committed.output)) {
+                            std::cerr << "Failed to write output file " << path.string() << std::endl;
+                            success = false;
+                        }
+                    } else if (committed.error.empty()) {
+                        if (print_headers) {
+                            out.format("File: {}\n", filename);
+                        }
+                        out.write(committed.output);
+                    }
+
+                    results[next_commit] = file_result{};
+                }
+            };
+
+            std::atomic<size_t> next_file{0};
+
+            run_workers(num_threads, [&] {
+                // Each worker compiles with its own runtime, which must be used on the thread that created it
+                JSRuntime* rt = JS_NewRuntime();
+                JS_SetModuleLoaderFunc(rt, nullptr, empty_module_loader, nullptr);
+                JSContext* ctx = JS_NewContext(rt);
+                js_std_add_helpers(ctx, 0, nullptr);
+
+                for (size_t i = next_file++; i < filenames.size(); i = next_file++) {
+                    if (!stream_output) {
+                        commit(i, disassemble_file(ctx, filenames[i], options));
+                        continue;
+                    }
+
+                    if (print_headers) {
+                        out.format("File: {}\n", filenames[i]);
+                    }
+
+                    file_result result;
+                    disassemble_file(ctx, filenames[i], options, out, result);
+                    collect(result);
+                }
+
+                JS_FreeContext(ctx);
+                JS_FreeRuntime(rt);
+            });
+
+            if (options.report == report_kind::stack) {
+                write_frame_ranking(out, frames, vm["top"].as<unsigned int>());
+                out.format("{} of {} function(s) failed the stack depth check\n", stack_failures, frames.size());
+                if (stack_failures > 0) success = false;
+            } else if (options.report == report_kind::poll_gaps) {
+                write_poll_gap_ranking(out, poll_gaps, vm["top"].as<unsigned int>());
+                out.format("{} function(s) have a loop which can run without polling\n", unbounded_polls);
+                if (unbounded_polls > 0) success = false;
+            } else if (options.report == report_kind::stats && format == output_format::json) {
+                write_stats_json(out, stats);
+            } else if (options.report == report_kind::stats) {
+                write_stats_text(out, stats);
+            } else if (options.report == report_kind::memory && filenames.size() > 1) {
+                out.write("All files:\n");
+                write_footprint_table(out, memory);
+            } else if (options.report == report_kind::short_forms && filenames.size() > 1) {
+                out.write("All files: ");
+                write_short_form_totals(out, short_forms);
+            }
+
+            if (options.report == report_kind::lint) {
+                if (filenames.size() > 1) {
+                    out.write("All files: ");
+                    write_lint_counts(out, lint);
+                }
+                for (const uint64_t count : lint) {
+                    if (count > 0) success = false;
+                }
+            }
+        }
+
+        out.flush();
+        write_ok = out.good();
+    }
+
+    if (output_file != stdout && fclose(output_file) != 0) {
+        write_ok = false;
+    }
+
+    if (!write_ok) {
+        std::cerr << "Failed to write output" << std::endl;
+        return 1;
+    }
 
-    return 0;
+    return success ? 0 : 1;
 }
@@ -0,0 +1,85 @@
+#include "frame_locations.h"
+#include <algorithm>
+#include <format>
+
+#include "pc2line_reader.h"
+#include "quickjs_bytecode.h"
+
+frame_locations::frame_locations(JSContext * ctx) : ctx(ctx) {}
+
+frame_locations::~frame_locations() {
+    for (auto & [key, entry] : functions) {
+        JS_FreeValue(ctx, entry.function);
+    }
+}
+
+int frame_locations::current() {
+    JSValueConst func;
+    const void * bytecode;
+    int pc;
+
+    if (!JS_GetCurrentFrame(ctx, &func, &bytecode, &pc)) {
+        if (no_frame < 0) no_frame = intern("(no JS frame)");
+        return no_frame;
+    }
+
+    const void * key = bytecode != nullptr ? bytecode : JS_VALUE_GET_PTR(func);
+    if (key != last_key) {
+        last_entry = &entry_for(func, bytecode);
+        last_key = key;
+    }
+
+    // Before its first call or branch, a function is placed at its start
+    const std::vector<int> & locations = last_entry->locations;
+    return locations[pc > 0 && static_cast<size_t>(pc) < locations.size() ? pc : 0];
+}
+
+frame_locations::function_entry & frame_locations::entry_for(const JSValueConst func, const void * bytecode) {
+    const void * key = bytecode != nullptr ? bytecode : JS_VALUE_GET_PTR(func);
+    auto [it, inserted] = functions.try_emplace(key);
+    function_entry & entry = it->second;
+    if (!inserted) return entry;
+
+    if (bytecode == nullptr) {
+        entry.function = JS_DupValue(ctx, func);
+
+        const JSValue name_value = JS_GetPropertyStr(ctx, func, "name");
+        const char * name = JS_IsString(name_value) ? JS_ToCString(ctx, name_value) : nullptr;
+        entry.locations.push_back(intern(std::format("{} (native)", name && *name ? name : "<anonymous>")));
+        if (name != nullptr) JS_FreeCString(ctx, name);
+        JS_FreeValue(ctx, name_value);
+        if (JS_HasException(ctx)) JS_FreeValue(ctx, JS_GetException(ctx));
+        return entry;
+    }
+
+    auto * b = static_cast<JSFunctionBytecode *>(const_cast<void *>(bytecode));
+    entry.function = JS_DupValue(ctx, JS_MKPTR(JS_TAG_FUNCTION_BYTECODE, b));
+
+    const char * name = b->func_name == JS_ATOM_NULL ? nullptr : JS_AtomToCString(ctx, b->func_name);
+    const char * file = b->filename == JS_ATOM_NULL ? nullptr : JS_AtomToCString(ctx, b->filename);
+    const std::string prefix = std::format("{} ({}", name && *name ? name : "<anonymous>", file ? file : "<null>");
+    if (name != nullptr) JS_FreeCString(ctx, name);
+    if (file != nullptr) JS_FreeCString(ctx, file);
+
+    // Neighbouring offsets mostly share a position, so each run of them is only interned once
+    pc2line_reader positions(b);
+    entry.locations.resize(std::max(b->byte_code_len, 1));
+    source_position previous{-1, -1};
+    int id = -1;
+    for (size_t pc = 0; pc < entry.locations.size(); pc++) {
+        const source_position position = positions.at(pc);
+        if (id < 0 || position.line != previous.line || position.col != previous.col) {
+            id = intern(std::format("{}:{}:{})", prefix, position.line, position.col));
+            previous = position;
+        }
+        entry.locations[pc] = id;
+    }
+
+    return entry;
+}
+
+int frame_locations::intern(std::string name) {
+    auto [it, inserted] = ids.try_emplace(std::move(name), static_cast<int>(names.size()));
+    if (inserted) names.push_back(it->first);
+    return it->second;
+}
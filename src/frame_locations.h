@@ -0,0 +1,50 @@
+#ifndef FRAME_LOCATIONS_H
+#define FRAME_LOCATIONS_H
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "quickjs.h"
+
+// Location of the innermost stack frame as "function (file:line:col)", or "function (native)" for C functions,
+// read from the frame's function and pc rather than from a backtrace. Each function's pc2line table is decoded
+// once into a location id for every offset of its bytecode, so finding the location at a poll is a lookup.
+// Functions are kept referenced until the table is destroyed, so their addresses are not reused meanwhile.
+class frame_locations {
+public:
+    explicit frame_locations(JSContext * ctx);
+    ~frame_locations();
+
+    frame_locations(const frame_locations &) = delete;
+    frame_locations & operator=(const frame_locations &) = delete;
+
+    // Id of the location the innermost frame is at. The first time a C function is seen its name property is
+    // read, which does not run JS unless the property is an accessor.
+    int current();
+
+    const std::string & name(const int id) const { return names[id]; }
+    size_t size() const { return names.size(); }
+
+private:
+    struct function_entry {
+        // The function bytecode, or the C function object, which the entry keeps alive
+        JSValue function;
+        // Location id by bytecode offset; a single entry for C functions
+        std::vector<int> locations;
+    };
+
+    function_entry & entry_for(JSValueConst func, const void * bytecode);
+    int intern(std::string name);
+
+    JSContext * ctx;
+    std::unordered_map<const void *, function_entry> functions;
+    // Most recent function looked up, as a loop keeps polling in the same one
+    const void * last_key = nullptr;
+    function_entry * last_entry = nullptr;
+
+    std::unordered_map<std::string, int> ids;
+    std::vector<std::string> names;
+    int no_frame = -1;
+};
+
+#endif //FRAME_LOCATIONS_H
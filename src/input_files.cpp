@@ -0,0 +1,95 @@
+#include "input_files.h"
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+#include <glob.h>
+
+namespace fs = std::filesystem;
+
+static bool has_extension(const fs::path & path, const std::vector<std::string> & extensions) {
+    return std::ranges::find(extensions, path.extension().string()) != extensions.end();
+}
+
+static bool collect_directory(const std::string & directory, const std::vector<std::string> & extensions,
+                              std::vector<std::string> & files) {
+    std::vector<std::string> found;
+    std::error_code error;
+
+    for (fs::recursive_directory_iterator it(directory, error), end; !error && it != end; it.increment(error)) {
+        if (it->is_regular_file(error) && has_extension(it->path(), extensions)) {
+            found.push_back(it->path().string());
+        }
+    }
+
+    if (error) {
+        std::cerr << "Failed to read directory " << directory << ": " << error.message() << std::endl;
+        return false;
+    }
+
+    std::sort(found.begin(), found.end());
+    files.insert(files.end(), found.begin(), found.end());
+    return true;
+}
+
+static bool collect_glob(const std::string & pattern, const std::vector<std::string> & extensions,
+                         std::vector<std::string> & files) {
+    glob_t matches;
+    const int result = glob(pattern.c_str(), 0, nullptr, &matches);
+
+    if (result != 0) {
+        globfree(&matches);
+        std::cerr << "No files match " << pattern << std::endl;
+        return false;
+    }
+
+    bool success = true;
+    for (size_t i = 0; i < matches.gl_pathc; i++) {
+        const std::string match = matches.gl_pathv[i];
+        if (fs::is_directory(match)) {
+            success = collect_directory(match, extensions, files) && success;
+        } else {
+            files.push_back(match);
+        }
+    }
+
+    globfree(&matches);
+    return success;
+}
+
+bool collect_input_files(const std::vector<std::string> & inputs, const std::vector<std::string> & extensions,
+                         std::vector<std::string> & files) {
+    bool success = true;
+
+    for (const auto & input : inputs) {
+        std::error_code error;
+
+        if (fs::is_directory(input, error)) {
+            success = collect_directory(input, extensions, files) && success;
+        } else if (!fs::exists(input, error) && input.find_first_of("*?[") != std::string::npos) {
+            success = collect_glob(input, extensions, files) && success;
+        } else {
+            files.push_back(input);
+        }
+    }
+
+    return success;
+}
+
+bool read_file_list(const std::string & list_filename, std::vector<std::string> & inputs) {
+    std::ifstream list(list_filename);
+
+    if (!list.is_open()) {
+        std::cerr << "Failed to open file list " << list_filename << std::endl;
+        return false;
+    }
+
+    std::string line;
+    while (std::getline(list, line)) {
+        if (line.ends_with('\r')) line.pop_back();
+        if (!line.empty()) inputs.push_back(line);
+    }
+
+    return true;
+}
@@ -0,0 +1,17 @@
+#ifndef INPUT_FILES_H
+#define INPUT_FILES_H
+#include <string>
+#include <vector>
+
+// Expands the given inputs into a list of files, in the order the inputs were given:
+// - directories are searched recursively for files with one of the given extensions, in sorted order
+// - inputs containing glob characters (*, ? or [) which are not existing paths are expanded with glob()
+// - anything else is taken as a file name
+// Returns false after printing an error if an input matches nothing.
+bool collect_input_files(const std::vector<std::string> & inputs, const std::vector<std::string> & extensions,
+                         std::vector<std::string> & files);
+
+// Reads one file name per line from a file list, skipping blank lines
+bool read_file_list(const std::string & list_filename, std::vector<std::string> & inputs);
+
+#endif //INPUT_FILES_H
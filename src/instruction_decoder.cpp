@@ -0,0 +1,153 @@
+#include "instruction_decoder.h"
+
+decoded_instruction decode_instruction(const JSFunctionBytecode * b, const uint32_t pos) {
+    const uint8_t op = b->byte_code_buf[pos];
+    const uint8_t * p = b->byte_code_buf + pos + 1;
+
+    decoded_instruction result{
+        .info = &get_instruction(op),
+        .pos = pos,
+        .operand_count = 0,
+        .operands = {},
+    };
+
+    auto add = [&](const operand_kind kind, const int64_t value) {
+        result.operands[result.operand_count++] = {kind, value};
+    };
+
+    // Jump offsets are relative to the position of the label operand itself
+    auto add_label = [&](const uint32_t operand_pos, const int32_t diff) {
+        add(operand_label, static_cast<int64_t>(operand_pos) + diff);
+    };
+
+    switch (result.info->format) {
+        case fmt_none:
+        case fmt_count:
+            break;
+        case fmt_none_int:
+            add(operand_int, op - op_push_0);
+            break;
+        case fmt_none_loc:
+            if (op == op_get_loc0_loc1) {
+                add(operand_local, 0);
+                add(operand_local, 1);
+            } else {
+                add(operand_local, (op - op_get_loc0) % 4);
+            }
+            break;
+        case fmt_none_arg:
+            add(operand_arg, (op - op_get_arg0) % 4);
+            break;
+        case fmt_none_var_ref:
+            add(operand_var_ref, (op - op_get_var_ref0) % 4);
+            break;
+        case fmt_u8:
+            add(operand_int, p[0]);
+            break;
+        case fmt_i8:
+            add(operand_int, static_cast<int8_t>(p[0]));
+            break;
+        case fmt_loc8:
+            add(operand_local, p[0]);
+            break;
+        case fmt_const8:
+            add(operand_const, p[0]);
+            break;
+        case fmt_label8:
+            add_label(pos + 1, static_cast<int8_t>(p[0]));
+            break;
+        case fmt_u16:
+            add(operand_int, read_operand<uint16_t>(p));
+            break;
+        case fmt_i16:
+            add(operand_int, read_operand<int16_t>(p));
+            break;
+        case fmt_label16:
+            add_label(pos + 1, read_operand<int16_t>(p));
+            break;
+        case fmt_npop:
+            add(operand_argc, read_operand<uint16_t>(p));
+            break;
+        case fmt_npopx:
+            add(operand_argc, op - op_call0);
+            break;
+        case fmt_npop_u16:
+            add(operand_argc, read_operand<uint16_t>(p));
+            add(operand_scope, read_operand<uint16_t>(p + 2));
+            break;
+        case fmt_loc:
+            add(operand_local, read_operand<uint16_t>(p));
+            break;
+        case fmt_arg:
+            add(operand_arg, read_operand<uint16_t>(p));
+            break;
+        case fmt_var_ref:
+            add(operand_var_ref, read_operand<uint16_t>(p));
+            break;
+        case fmt_u32:
+            add(operand_int, read_operand<uint32_t>(p));
+            break;
+        case fmt_u32x2:
+            add(operand_int, read_operand<uint32_t>(p));
+            add(operand_int, read_operand<uint32_t>(p + 4));
+            break;
+        case fmt_i32:
+            add(operand_int, read_operand<int32_t>(p));
+            break;
+        case fmt_const:
+            add(operand_const, read_operand<uint32_t>(p));
+            break;
+        case fmt_label:
+            add_label(pos + 1, read_operand<int32_t>(p));
+            break;
+        case fmt_atom:
+            add(operand_atom, read_operand<JSAtom>(p));
+            break;
+        case fmt_atom_u8:
+            add(operand_atom, read_operand<JSAtom>(p));
+            add(operand_int, p[4]);
+            break;
+        case fmt_atom_u16:
+            add(operand_atom, read_operand<JSAtom>(p));
+            add(operand_int, read_operand<uint16_t>(p + 4));
+            break;
+        case fmt_atom_label_u8:
+            add(operand_atom, read_operand<JSAtom>(p));
+            add_label(pos + 5, read_operand<int32_t>(p + 4));
+            add(operand_int, p[8]);
+            break;
+        case fmt_atom_label_u16:
+            add(operand_atom, read_operand<JSAtom>(p));
+            add_label(pos + 5, read_operand<int32_t>(p + 4));
+            add(operand_int, read_operand<uint16_t>(p + 8));
+            break;
+        case fmt_label_u16:
+            add_label(pos + 1, read_operand<int32_t>(p));
+            add(operand_int, read_operand<uint16_t>(p + 4));
+            break;
+    }
+
+    return result;
+}
+
+int64_t label_target(const decoded_instruction & insn) {
+    for (int i = 0; i < insn.operand_count; i++) {
+        if (insn.operands[i].kind == operand_label) return insn.operands[i].value;
+    }
+    return -1;
+}
+
+std::string_view operand_kind_name(const operand_kind kind) {
+    switch (kind) {
+        case operand_int: return "int";
+        case operand_local: return "local";
+        case operand_arg: return "arg";
+        case operand_var_ref: return "var_ref";
+        case operand_const: return "const";
+        case operand_label: return "label";
+        case operand_atom: return "atom";
+        case operand_argc: return "argc";
+        case operand_scope: return "scope";
+    }
+    return "unknown";
+}
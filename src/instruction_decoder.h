@@ -0,0 +1,58 @@
+#ifndef INSTRUCTION_DECODER_H
+#define INSTRUCTION_DECODER_H
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+#include "opcodes.h"
+#include "quickjs_bytecode.h"
+
+// Bytecode in memory uses the host byte order; JS_ReadObject converts serialized bytecode on load
+template <typename T>
+T read_operand(const uint8_t * p) {
+    T value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+enum operand_kind : uint8_t {
+    operand_int,
+    // Index into the function's local variables
+    operand_local,
+    // Index into the function's arguments
+    operand_arg,
+    // Index into the function's closure variables
+    operand_var_ref,
+    // Index into the function's constant pool
+    operand_const,
+    // Absolute offset of a jump target
+    operand_label,
+    operand_atom,
+    // Number of arguments of a call
+    operand_argc,
+    operand_scope,
+};
+
+struct operand {
+    operand_kind kind;
+    int64_t value;
+};
+
+// Operands of an instruction decoded according to the FMT column of its opcode
+struct decoded_instruction {
+    const instruction * info;
+    uint32_t pos;
+    uint8_t operand_count;
+    std::array<operand, 3> operands;
+};
+
+decoded_instruction decode_instruction(const JSFunctionBytecode * b, uint32_t pos);
+
+// Offset the instruction's label operand jumps to, or -1 if it has none
+int64_t label_target(const decoded_instruction & insn);
+
+// Name used for an operand kind in machine-readable output
+std::string_view operand_kind_name(operand_kind kind);
+
+#endif //INSTRUCTION_DECODER_H
@@ -1,62 +1,932 @@
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <format>
 #include <fstream>
 #include <iostream>
+#include <limits>
+#include <optional>
 #include <random>
+#include <set>
 #include <sstream>
+#include <unordered_map>
+
+#include <sys/wait.h>
+#include <unistd.h>
 
 #include <boost/program_options.hpp>
 
 #include "quickjs-libc.h"
 #include "quickjs.h"
+#include "frame_locations.h"
 #include "utilities.h"
 
 namespace po = boost::program_options;
 
+struct trial_result {
+    int num_interrupts;
+    // Errors raised by the script or the called functions, other than the interruption itself
+    std::vector<std::string> errors;
+    bool interrupted;
+};
+
+struct forked_trial {
+    pid_t pid;
+    int fd;
+    int point;
+};
+
+// State for --fork sweeps. The parent runs the script once without interruption and forks a child
+// at every interruption point; the child takes the interrupt, finishes the trial and reports its
+// result through a pipe, so no prefix of the script is executed twice.
+struct fork_sweep_state {
+    bool is_child;
+    int result_fd;
+
+    unsigned int max_children;
+    std::deque<forked_trial> children;
+    std::vector<trial_result> results;
+    // Points a child was forked at
+    std::vector<int> points;
+};
+
+bool fork_trial(fork_sweep_state & state, int point);
+
+// Source locations the interruption points of a run were hit at, as "function (file:line:col)"
+struct location_histogram {
+    // Points are selected for a sweep if their location contains one of these, or all points if empty
+    std::vector<std::string> filters;
+
+    // Indexed by the location ids of the run's frame_locations; names are copied as locations are hit
+    std::vector<std::string> names;
+    std::vector<uint64_t> hits;
+    std::vector<bool> selected;
+
+    // Location id of every point, in order, only kept for a threaded sweep which selects its points from them
+    bool keep_point_locations;
+    std::vector<int> point_locations;
+};
+
+using latency_clock = std::chrono::steady_clock;
+
+// Counts of gaps in nanoseconds, in buckets for each power of two split into GAP_SUB_BUCKETS, so the bucket a
+// percentile falls in is within 1/GAP_SUB_BUCKETS of it. Gaps under GAP_SUB_BUCKETS ns get a bucket each.
+constexpr int GAP_SUB_BUCKET_BITS = 3;
+constexpr uint64_t GAP_SUB_BUCKETS = 1 << GAP_SUB_BUCKET_BITS;
+
+class gap_histogram {
+public:
+    void add(const latency_clock::duration gap) {
+        const auto ns = static_cast<uint64_t>(std::max<int64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(gap).count(), 0));
+        counts[bucket(ns)]++;
+        count++;
+        total += ns;
+        max = std::max(max, ns);
+    }
+
+    uint64_t size() const { return count; }
+    uint64_t total_ns() const { return total; }
+    uint64_t max_ns() const { return max; }
+
+    // Upper bound of the gaps at the given share of all gaps by nearest rank, never more than the longest gap
+    uint64_t percentile_ns(const double share) const {
+        const auto rank = std::max<uint64_t>(static_cast<uint64_t>(std::ceil(share * static_cast<double>(count))), 1);
+        uint64_t seen = 0;
+        for (size_t i = 0; i < counts.size(); i++) {
+            seen += counts[i];
+            if (seen >= rank) return std::min(bucket_upper_bound(i), max);
+        }
+        return max;
+    }
+
+private:
+    static size_t bucket(const uint64_t ns) {
+        if (ns < GAP_SUB_BUCKETS) return ns;
+        const int shift = std::bit_width(ns) - 1 - GAP_SUB_BUCKET_BITS;
+        return (shift + 1) * GAP_SUB_BUCKETS + ((ns >> shift) & (GAP_SUB_BUCKETS - 1));
+    }
+
+    static uint64_t bucket_upper_bound(const size_t index) {
+        if (index < GAP_SUB_BUCKETS) return index;
+        const int shift = static_cast<int>(index / GAP_SUB_BUCKETS) - 1;
+        const uint64_t lower = (GAP_SUB_BUCKETS + index % GAP_SUB_BUCKETS) << shift;
+        return lower + ((uint64_t{1} << shift) - 1);
+    }
+
+    std::array<uint64_t, (64 - GAP_SUB_BUCKET_BITS) * GAP_SUB_BUCKETS> counts{};
+    uint64_t count = 0;
+    uint64_t total = 0;
+    uint64_t max = 0;
+};
+
+struct slow_gap {
+    latency_clock::duration length;
+    // Points the gap starts and ends at, -1 for the start or the end of the run
+    int64_t from_point;
+    int64_t to_point;
+    // Locations of the polls around the gap
+    std::string from;
+    std::string to;
+};
+
+// Time the script runs between interrupt polls, which bounds how long it takes to stop it. The handler's own time
+// is left out. Memory does not grow with the number of polls.
+struct poll_latency {
+    // When the last poll handler returned, or the run started
+    latency_clock::time_point last_poll;
+    gap_histogram histogram;
+
+    // The longest gaps, as a heap with the shortest of them on top
+    size_t max_slow_gaps;
+    std::vector<slow_gap> slow_gaps;
+
+    // Location id of the last point in the run's frame_locations, only named if a gap starting there is slow
+    int last_location;
+};
+
+bool longer_gap(const slow_gap & a, const slow_gap & b) {
+    return a.length > b.length;
+}
+
+// Whether a gap is long enough to be kept among the longest, so its locations are worth capturing
+bool is_slow_gap(const poll_latency & latency, const latency_clock::duration gap) {
+    if (latency.max_slow_gaps == 0) return false;
+    return latency.slow_gaps.size() < latency.max_slow_gaps || gap > latency.slow_gaps.front().length;
+}
+
+void add_slow_gap(poll_latency & latency, slow_gap gap) {
+    if (latency.slow_gaps.size() == latency.max_slow_gaps) {
+        std::ranges::pop_heap(latency.slow_gaps, longer_gap);
+        latency.slow_gaps.pop_back();
+    }
+    latency.slow_gaps.push_back(std::move(gap));
+    std::ranges::push_heap(latency.slow_gaps, longer_gap);
+}
+
+// Marks a file of interrupted points written by --record, which are then stored one unsigned LEB128 varint
+// each: the distance from the previous point, less one, or the point itself for the first
+constexpr std::string_view REPLAY_LOG_MAGIC = "QJIRPLY1";
+
+// Appends the points a run is interrupted at to a replay log as they are taken, so a run which crashes keeps them
+struct replay_log_writer {
+    FILE * file;
+    int64_t last_point;
+};
+
+bool open_replay_log(const std::string & filename, replay_log_writer & log) {
+    log.file = fopen(filename.c_str(), "wb");
+    log.last_point = -1;
+    if (log.file == nullptr) return false;
+    return fwrite(REPLAY_LOG_MAGIC.data(), 1, REPLAY_LOG_MAGIC.size(), log.file) == REPLAY_LOG_MAGIC.size()
+        && fflush(log.file) == 0;
+}
+
+bool log_interrupted_point(replay_log_writer & log, const int64_t point) {
+    uint64_t value = point - log.last_point - 1;
+    log.last_point = point;
+
+    uint8_t bytes[10];
+    size_t size = 0;
+    do {
+        bytes[size] = value & 0x7f;
+        value >>= 7;
+        if (value != 0) bytes[size] |= 0x80;
+        size++;
+    } while (value != 0);
+
+    return fwrite(bytes, 1, size, log.file) == size && fflush(log.file) == 0;
+}
+
+// Reads the points of a replay log in order. Returns false if the file cannot be read or is not a replay log.
+bool read_replay_log(const std::string & filename, std::vector<int> & points) {
+    std::ifstream file(filename, std::ios::binary);
+    if (!file.is_open()) return false;
+    const std::string data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    if (!data.starts_with(REPLAY_LOG_MAGIC)) return false;
+
+    int64_t point = -1;
+    size_t pos = REPLAY_LOG_MAGIC.size();
+    while (pos < data.size()) {
+        uint64_t value = 0;
+        int shift = 0;
+        uint8_t byte;
+        do {
+            if (pos == data.size() || shift > 56) return false;
+            byte = static_cast<uint8_t>(data[pos++]);
+            value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+            shift += 7;
+        } while (byte & 0x80);
+
+        point += static_cast<int64_t>(value) + 1;
+        if (point > std::numeric_limits<int>::max()) return false;
+        points.push_back(static_cast<int>(point));
+    }
+
+    return true;
+}
+
 struct interrupt_handler_data {
     bool suppress;
 
     bool verbose;
     int num_interrupts;
 
-    std::set<int> interrupt_at;
-    double interrupt_chance;
+    // Points to interrupt at, sorted, and the index of the first one not reached yet
+    std::vector<int> interrupt_at;
+    size_t next_scheduled;
 
+    // Chance to interrupt at each point, from 0 to 1; 0 or less never interrupts at random
+    double interrupt_chance;
     std::mt19937* generator;
-    std::uniform_real_distribution<double> * random_distribution;
+    // Next point to interrupt at at random. The gap to it is drawn from a geometric distribution, which is
+    // the same as drawing at every point, without a draw per point.
+    int64_t next_random;
+
+    // The earlier of the next scheduled and the next random point, so other points only take one compare
+    int64_t next_interrupt;
+
+    fork_sweep_state * fork_state;
+    // Where the points the run is interrupted at are recorded for --record
+    replay_log_writer * record;
+
+    location_histogram * locations;
+    poll_latency * latency;
+    // Set by run_trial when locations are recorded
+    frame_locations * frames;
 };
 
+// Point number meaning no point
+constexpr int64_t NO_POINT = std::numeric_limits<int64_t>::max();
+
+// Moves the scheduled and random targets past the given point and picks the next point to interrupt at
+void advance_interrupt_schedule(interrupt_handler_data & data, const int64_t point) {
+    while (data.next_scheduled < data.interrupt_at.size() && data.interrupt_at[data.next_scheduled] <= point) {
+        data.next_scheduled++;
+    }
+    const int64_t scheduled = data.next_scheduled < data.interrupt_at.size()
+        ? data.interrupt_at[data.next_scheduled]
+        : NO_POINT;
+
+    if (data.interrupt_chance <= 0) {
+        data.next_random = NO_POINT;
+    } else if (data.interrupt_chance >= 1) {
+        // The distribution needs a chance below 1, and every point is taken anyway
+        data.next_random = point + 1;
+    } else if (data.next_random <= point) {
+        // Number of points passed over before the next one taken, kept from running past NO_POINT
+        std::geometric_distribution<int64_t> skip(data.interrupt_chance);
+        data.next_random = point + 1 + std::clamp<int64_t>(skip(*data.generator), 0, NO_POINT - point - 1);
+    }
+
+    data.next_interrupt = std::min(scheduled, data.next_random);
+}
+
+// Picks the first point to interrupt at, before the run reaches any
+void start_interrupt_schedule(interrupt_handler_data & data) {
+    data.next_scheduled = 0;
+    data.next_random = -1;
+    advance_interrupt_schedule(data, data.num_interrupts - 1);
+}
+
+// Id of the location of the current poll
+int current_location(interrupt_handler_data & data) {
+    // Reading the name of a C function seen for the first time could poll, which is not a point of the script
+    data.suppress = true;
+    const int id = data.frames->current();
+    data.suppress = false;
+    return id;
+}
+
+// Records the location of the current point and returns its id
+int record_location(interrupt_handler_data & data) {
+    location_histogram & locations = *data.locations;
+    const int id = current_location(data);
+
+    if (static_cast<size_t>(id) >= locations.hits.size()) {
+        locations.names.resize(data.frames->size());
+        locations.hits.resize(data.frames->size(), 0);
+        locations.selected.resize(data.frames->size(), false);
+    }
+    if (locations.hits[id] == 0) {
+        const std::string & name = data.frames->name(id);
+        locations.names[id] = name;
+        locations.selected[id] = locations.filters.empty() || std::ranges::any_of(locations.filters,
+            [&](const std::string & filter) { return name.find(filter) != std::string::npos; });
+    }
+
+    locations.hits[id]++;
+    if (locations.keep_point_locations) {
+        locations.point_locations.push_back(id);
+    }
+    return id;
+}
+
+// Name of the location at which the last gap started
+std::string gap_start(const interrupt_handler_data & data) {
+    if (data.latency->last_location < 0) return "(start of run)";
+    return data.frames->name(data.latency->last_location);
+}
+
 int interrupt_handler(JSRuntime * rt, void * opaque) {
     auto *data = static_cast<interrupt_handler_data *>(opaque);
 
     if (data->suppress) return 0;
 
+    const latency_clock::duration gap = data->latency ? latency_clock::now() - data->latency->last_poll
+                                                      : latency_clock::duration{};
+
+    // A forked child only finishes its trial, the parent records the locations of the run
+    const bool is_child = data->fork_state && data->fork_state->is_child;
+    const int location = data->locations && !is_child ? record_location(*data) : -1;
+
+    if (data->latency) {
+        poll_latency & latency = *data->latency;
+        latency.histogram.add(gap);
+
+        // Only the id is kept at every poll, the names are looked up for the few slow gaps
+        const int gap_end = location >= 0 ? location : current_location(*data);
+        if (is_slow_gap(latency, gap)) {
+            add_slow_gap(latency, {
+                .length = gap,
+                .from_point = data->num_interrupts - 1,
+                .to_point = data->num_interrupts,
+                .from = gap_start(*data),
+                .to = data->frames->name(gap_end),
+            });
+        }
+        latency.last_location = gap_end;
+    }
+
     if (data->verbose) {
-        std::cout << "Interruption Point " << data->num_interrupts << std::endl;
+        std::cout << "Interruption Point " << data->num_interrupts;
+        if (location >= 0) std::cout << " at " << data->locations->names[location];
+        std::cout << std::endl;
     }
 
-    bool interrupt = data->interrupt_at.contains(data->num_interrupts);
+    if (data->fork_state && !is_child && (location < 0 || data->locations->selected[location])) {
+        data->fork_state->points.push_back(data->num_interrupts);
+        if (fork_trial(*data->fork_state, data->num_interrupts)) {
+            // This is the child for the current point, which takes the interrupt
+            data->num_interrupts++;
+            return 1;
+        }
+    }
 
-    data->num_interrupts++;
+    const int point = data->num_interrupts++;
+    const bool interrupt = point == data->next_interrupt;
 
-    if (data->interrupt_chance >= 0) {
-        if ((*data->random_distribution)(*data->generator) < data->interrupt_chance) {
-            return 1;
+    if (interrupt) {
+        advance_interrupt_schedule(*data, point);
+
+        if (data->record && !log_interrupted_point(*data->record, point)) {
+            std::cerr << "Failed to write to the replay log" << std::endl;
+            data->record = nullptr;
         }
     }
 
+    if (data->latency) {
+        data->latency->last_poll = latency_clock::now();
+    }
+
     return interrupt ? 1 : 0;
 }
 
-int main(const int argc, char * argv[]) {
-    std::random_device rd;
-    std::mt19937 mt(rd());
-    std::uniform_real_distribution<double> dist(0.0, 1.0);
+// Takes the pending exception from the context. Errors are either dumped to stderr
+// like the QuickJS shell does or recorded in the trial result.
+void handle_exception(JSContext * ctx, interrupt_handler_data & handler_data, trial_result & result, const bool dump_errors) {
+    handler_data.suppress = true;
+
+    if (dump_errors) {
+        js_std_dump_error(ctx);
+    } else {
+        const JSValue exception = JS_GetException(ctx);
+        if (JS_IsUncatchableError(ctx, exception)) {
+            result.interrupted = true;
+        } else {
+            result.errors.push_back(exception_to_string(ctx, exception));
+        }
+        JS_FreeValue(ctx, exception);
+    }
+
+    handler_data.suppress = false;
+}
+
+// Compiles the script once, so trials only have to instantiate the serialized bytecode
+// instead of parsing the source again. Returns false after dumping the error if compilation fails.
+bool compile_script(const std::string & code, const std::string & filename, std::vector<uint8_t> & bytecode) {
+    JSRuntime* rt = JS_NewRuntime();
+    JSContext* ctx = JS_NewContext(rt);
+
+    const JSValue obj = JS_Eval(ctx, code.c_str(), code.length(), filename.c_str(), JS_EVAL_TYPE_GLOBAL | JS_EVAL_FLAG_COMPILE_ONLY);
+    bool success = !JS_IsException(obj);
+
+    if (success) {
+        size_t size;
+        uint8_t * buffer = JS_WriteObject(ctx, &size, obj, JS_WRITE_OBJ_BYTECODE);
+        if (buffer) {
+            bytecode.assign(buffer, buffer + size);
+            js_free(ctx, buffer);
+        } else {
+            success = false;
+        }
+    }
+
+    if (!success) {
+        js_std_dump_error(ctx);
+    }
+
+    JS_FreeValue(ctx, obj);
+    JS_FreeContext(ctx);
+    JS_FreeRuntime(rt);
+    return success;
+}
+
+// Evaluates the compiled script and calls the requested functions in a fresh runtime
+trial_result run_trial(const std::vector<uint8_t> & bytecode, const std::vector<std::string> & functions,
+                       interrupt_handler_data & handler_data, const bool dump_errors) {
+    trial_result result{
+        .num_interrupts = 0,
+        .errors = {},
+        .interrupted = false,
+    };
+
+    JSRuntime* rt = JS_NewRuntime();
+    JSContext* ctx = JS_NewContext(rt);
+    js_std_add_helpers(ctx, 0, nullptr);
+
+    start_interrupt_schedule(handler_data);
+
+    std::optional<frame_locations> frames;
+    if (handler_data.locations || handler_data.latency) {
+        handler_data.frames = &frames.emplace(ctx);
+    }
+
+    JS_SetInterruptHandler(rt, interrupt_handler, &handler_data);
+
+    const JSValue obj = JS_ReadObject(ctx, bytecode.data(), bytecode.size(), JS_READ_OBJ_BYTECODE);
+
+    if (handler_data.latency) {
+        handler_data.latency->last_poll = latency_clock::now();
+    }
+
+    const JSValue val = JS_IsException(obj) ? obj : JS_EvalFunction(ctx, obj);
+
+    // Take the exception before calling any functions, which would otherwise replace it
+    if (JS_IsException(val)) {
+        handle_exception(ctx, handler_data, result, dump_errors);
+    }
+
+    JS_FreeValue(ctx, val);
+
+    if (!functions.empty()) {
+        JSValue global = JS_GetGlobalObject(ctx);
+
+        for (const auto& function : functions) {
+            JSAtom function_atom = JS_NewAtom(ctx, function.c_str());
+            JSValue function_value = JS_GetProperty(ctx, global, function_atom);
+
+            const JSValue return_val = JS_Call(ctx, function_value, function_value, 0, nullptr);
+
+            if (JS_IsException(return_val)) {
+                handle_exception(ctx, handler_data, result, dump_errors);
+            }
+
+            JS_FreeAtom(ctx, function_atom);
+            JS_FreeValue(ctx, function_value);
+            JS_FreeValue(ctx, return_val);
+        }
+
+        JS_FreeValue(ctx, global);
+    }
+
+    if (handler_data.latency) {
+        poll_latency & latency = *handler_data.latency;
+        const latency_clock::duration gap = latency_clock::now() - latency.last_poll;
+        latency.histogram.add(gap);
+
+        if (is_slow_gap(latency, gap)) {
+            add_slow_gap(latency, {
+                .length = gap,
+                .from_point = handler_data.num_interrupts - 1,
+                .to_point = -1,
+                .from = gap_start(handler_data),
+                .to = "(end of run)",
+            });
+        }
+    }
+
+    result.num_interrupts = handler_data.num_interrupts;
+
+    // The table keeps functions referenced, so it goes before the context
+    handler_data.frames = nullptr;
+    frames.reset();
+
+    JS_FreeContext(ctx);
+    JS_FreeRuntime(rt);
+    return result;
+}
+
+// Prints the trials which raised errors not seen in an uninterrupted run and returns their number.
+// results is indexed by point, and only the swept points are reported.
+int report_sweep(const trial_result & baseline, const std::vector<trial_result> & results,
+                 const std::vector<int> & points) {
+    const int num_points = static_cast<int>(points.size());
+    const std::set<std::string> baseline_errors(baseline.errors.begin(), baseline.errors.end());
+
+    int failures = 0;
+
+    for (const int point : points) {
+        const trial_result & result = results[point];
+
+        std::vector<const std::string *> new_errors;
+        for (const auto & error : result.errors) {
+            if (!baseline_errors.contains(error)) {
+                new_errors.push_back(&error);
+            }
+        }
+
+        if (!result.interrupted) {
+            std::cout << "Interruption Point " << point << ": not reached" << std::endl;
+        }
+
+        if (new_errors.empty()) continue;
+
+        failures++;
+        std::cout << "Interruption Point " << point << ": " << new_errors.size() << " new error(s)" << std::endl;
+        for (const auto * error : new_errors) {
+            std::cout << *error << std::endl;
+        }
+    }
 
+    std::cout << num_points - failures << "/" << num_points << " trial(s) recovered." << std::endl;
+
+    return failures;
+}
+
+// Interrupts every interruption point in turn, each trial in its own runtime. With locations, the
+// uninterrupted run records them and only the points it selects are swept.
+// Returns the number of trials which raised errors not seen in an uninterrupted run.
+int sweep(const std::vector<uint8_t> & bytecode, const std::vector<std::string> & functions,
+          const unsigned int num_threads, location_histogram * locations) {
+    interrupt_handler_data count_data{
+        .suppress = false,
+        .verbose = false,
+        .num_interrupts = 0,
+        .interrupt_at = {},
+        .next_scheduled = 0,
+        .interrupt_chance = -1,
+        .generator = nullptr,
+        .next_random = 0,
+        .next_interrupt = 0,
+        .fork_state = nullptr,
+        .record = nullptr,
+        .locations = locations,
+        .latency = nullptr,
+        .frames = nullptr,
+    };
+
+    const trial_result baseline = run_trial(bytecode, functions, count_data, false);
+    const int num_points = baseline.num_interrupts;
+
+    std::vector<int> points;
+    for (int point = 0; point < num_points; point++) {
+        if (!locations || locations->selected[locations->point_locations[point]]) points.push_back(point);
+    }
+
+    std::cout << num_points << " total interruption point(s)." << std::endl;
+    std::cout << "Sweeping " << points.size() << " interruption point(s) using " << num_threads << " thread(s)" << std::endl;
+
+    std::vector<trial_result> results(num_points);
+
+    parallel_for(points.size(), num_threads, [&](const size_t index) {
+        const int point = points[index];
+        interrupt_handler_data trial_data{
+            .suppress = false,
+            .verbose = false,
+            .num_interrupts = 0,
+            .interrupt_at = {point},
+            .next_scheduled = 0,
+            .interrupt_chance = -1,
+            .generator = nullptr,
+            .next_random = 0,
+            .next_interrupt = 0,
+            .fork_state = nullptr,
+            .record = nullptr,
+            .locations = nullptr,
+            .latency = nullptr,
+            .frames = nullptr,
+        };
+
+        results[point] = run_trial(bytecode, functions, trial_data, false);
+    });
+
+    return report_sweep(baseline, results, points);
+}
+
+// Drops the line and column from a location, leaving "function (file)"
+std::string location_function(const std::string_view location) {
+    const size_t open = location.rfind(" (");
+    if (open == std::string_view::npos || !location.ends_with(')')) return std::string(location);
+
+    std::string_view position = location.substr(open + 2, location.size() - open - 3);
+    for (int i = 0; i < 2; i++) {
+        const size_t colon = position.rfind(':');
+        if (colon == std::string_view::npos) break;
+        const std::string_view number = position.substr(colon + 1);
+        if (number.empty() || !std::ranges::all_of(number, [](const char c) { return c >= '0' && c <= '9'; })) break;
+        position = position.substr(0, colon);
+    }
+
+    return std::format("{} ({})", location.substr(0, open), position);
+}
+
+// Prints the locations and then the functions hit by the most interruption points, count of each
+void write_location_histogram(const location_histogram & locations, const size_t count) {
+    uint64_t total = 0;
+    std::unordered_map<std::string, uint64_t> function_hits;
+    for (size_t id = 0; id < locations.hits.size(); id++) {
+        if (locations.hits[id] == 0) continue;
+        total += locations.hits[id];
+        function_hits[location_function(locations.names[id])] += locations.hits[id];
+    }
+
+    const auto write_ranking = [&](const std::string_view title, std::vector<std::pair<std::string_view, uint64_t>> ranking) {
+        std::ranges::sort(ranking, [](const auto & a, const auto & b) {
+            return a.second != b.second ? a.second > b.second : a.first < b.first;
+        });
+
+        std::cout << std::format("{:>16}  {}\n", "Points", title);
+        for (size_t i = 0; i < std::min(count, ranking.size()); i++) {
+            const auto & [name, hits] = ranking[i];
+            const double share = total == 0 ? 0.0 : 100.0 * static_cast<double>(hits) / static_cast<double>(total);
+            std::cout << std::format("{:8} {:6.2f}%  {}\n", hits, share, name);
+        }
+    };
+
+    std::vector<std::pair<std::string_view, uint64_t>> by_location;
+    for (size_t id = 0; id < locations.hits.size(); id++) {
+        if (locations.hits[id] > 0) by_location.emplace_back(locations.names[id], locations.hits[id]);
+    }
+    write_ranking("Location", std::move(by_location));
+
+    std::vector<std::pair<std::string_view, uint64_t>> by_function(function_hits.begin(), function_hits.end());
+    write_ranking("Function", std::move(by_function));
+    std::cout.flush();
+}
+
+// Prints the percentiles of the gaps between polls and the longest ones, with the points and locations of the
+// polls they ran between. Returns the longest gap in ms.
+double write_poll_latency(const poll_latency & latency) {
+    const auto ms = [](const uint64_t ns) { return static_cast<double>(ns) / 1e6; };
+    const gap_histogram & histogram = latency.histogram;
+
+    if (histogram.size() == 0) return 0;
+
+    std::cout << std::format("{} gap(s) between interrupt polls, {:.3f} ms in total\n",
+                             histogram.size(), ms(histogram.total_ns()));
+    std::cout << std::format("p50 {:.3f} ms, p99 {:.3f} ms, p99.9 {:.3f} ms, max {:.3f} ms\n",
+                             ms(histogram.percentile_ns(0.5)), ms(histogram.percentile_ns(0.99)),
+                             ms(histogram.percentile_ns(0.999)), ms(histogram.max_ns()));
+
+    std::vector<slow_gap> longest = latency.slow_gaps;
+    std::ranges::sort(longest, [](const slow_gap & a, const slow_gap & b) {
+        if (a.length != b.length) return a.length > b.length;
+        // The end of the run, -1, goes after the points
+        return static_cast<uint64_t>(a.to_point) < static_cast<uint64_t>(b.to_point);
+    });
+
+    std::cout << std::format("{:>13}  {:>9}  {:>9}  From  ->  To\n", "Gap", "From", "To");
+
+    for (const slow_gap & gap : longest) {
+        const uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(gap.length).count();
+        const std::string from = gap.from_point < 0 ? std::string("start") : std::to_string(gap.from_point);
+        const std::string to = gap.to_point < 0 ? std::string("end") : std::to_string(gap.to_point);
+        std::cout << std::format("{:10.3f} ms  {:>9}  {:>9}  {}  ->  {}\n", ms(ns), from, to, gap.from, gap.to);
+    }
+    std::cout.flush();
+
+    return ms(histogram.max_ns());
+}
+
+void write_all(const int fd, const std::string & data) {
+    size_t written = 0;
+    while (written < data.size()) {
+        const ssize_t n = write(fd, data.data() + written, data.size() - written);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return;
+        }
+        written += n;
+    }
+}
+
+std::string read_all(const int fd) {
+    std::string data;
+    char buffer[4096];
+    for (;;) {
+        const ssize_t n = read(fd, buffer, sizeof(buffer));
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (n == 0) break;
+        data.append(buffer, n);
+    }
+    return data;
+}
+
+void append_u32(std::string & data, const uint32_t value) {
+    data.append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+bool take_u32(const std::string & data, size_t & pos, uint32_t & value) {
+    if (pos + sizeof(value) > data.size()) return false;
+    memcpy(&value, data.data() + pos, sizeof(value));
+    pos += sizeof(value);
+    return true;
+}
+
+// Results are sent from a child to the parent as u32 fields: num_interrupts, interrupted,
+// error count, then a length and the bytes of each error
+std::string serialize_trial_result(const trial_result & result) {
+    std::string data;
+    append_u32(data, result.num_interrupts);
+    append_u32(data, result.interrupted ? 1 : 0);
+    append_u32(data, result.errors.size());
+    for (const auto & error : result.errors) {
+        append_u32(data, error.size());
+        data += error;
+    }
+    return data;
+}
+
+bool deserialize_trial_result(const std::string & data, trial_result & result) {
+    size_t pos = 0;
+    uint32_t num_interrupts, interrupted, num_errors;
+    if (!take_u32(data, pos, num_interrupts) || !take_u32(data, pos, interrupted) || !take_u32(data, pos, num_errors)) {
+        return false;
+    }
+
+    result.num_interrupts = static_cast<int>(num_interrupts);
+    result.interrupted = interrupted != 0;
+
+    for (uint32_t i = 0; i < num_errors; i++) {
+        uint32_t length;
+        if (!take_u32(data, pos, length) || pos + length > data.size()) return false;
+        result.errors.emplace_back(data, pos, length);
+        pos += length;
+    }
+
+    return pos == data.size();
+}
+
+void reap_oldest_child(fork_sweep_state & state) {
+    const forked_trial child = state.children.front();
+    state.children.pop_front();
+
+    const std::string data = read_all(child.fd);
+    close(child.fd);
+
+    int status = 0;
+    while (waitpid(child.pid, &status, 0) < 0 && errno == EINTR) {}
+
+    trial_result result{
+        .num_interrupts = 0,
+        .errors = {},
+        .interrupted = true,
+    };
+
+    if (WIFSIGNALED(status)) {
+        result.errors.push_back(std::string("Trial process killed by signal ") + strsignal(WTERMSIG(status)));
+    } else if (!WIFEXITED(status) || WEXITSTATUS(status) != 0 || !deserialize_trial_result(data, result)) {
+        result.errors.push_back("Trial process exited without reporting a result");
+    }
+
+    if (state.results.size() <= static_cast<size_t>(child.point)) {
+        state.results.resize(child.point + 1);
+    }
+    state.results[child.point] = std::move(result);
+}
+
+// Forks a child for the given interruption point. Returns true in the child.
+bool fork_trial(fork_sweep_state & state, const int point) {
+    while (!state.children.empty() && state.children.size() >= state.max_children) {
+        reap_oldest_child(state);
+    }
+
+    int fds[2];
+    if (pipe(fds) != 0) {
+        std::cerr << "Failed to create pipe: " << strerror(errno) << std::endl;
+        std::exit(1);
+    }
+
+    // Anything still buffered would otherwise be written by both processes
+    std::cout.flush();
+    fflush(stdout);
+
+    const pid_t pid = fork();
+
+    if (pid < 0) {
+        std::cerr << "Failed to fork: " << strerror(errno) << std::endl;
+        std::exit(1);
+    }
+
+    if (pid == 0) {
+        close(fds[0]);
+        for (const auto & child : state.children) {
+            close(child.fd);
+        }
+        state.children.clear();
+        state.is_child = true;
+        state.result_fd = fds[1];
+        return true;
+    }
+
+    close(fds[1]);
+    state.children.push_back({
+        .pid = pid,
+        .fd = fds[0],
+        .point = point,
+    });
+    return false;
+}
+
+// Same as sweep, but forks a child at every selected interruption point of a single run instead of
+// replaying the script from the start for every trial
+int sweep_fork(const std::vector<uint8_t> & bytecode, const std::vector<std::string> & functions,
+               const unsigned int max_children, location_histogram * locations) {
+    fork_sweep_state state{
+        .is_child = false,
+        .result_fd = -1,
+        .max_children = max_children,
+        .children = {},
+        .results = {},
+        .points = {},
+    };
+
+    interrupt_handler_data handler_data{
+        .suppress = false,
+        .verbose = false,
+        .num_interrupts = 0,
+        .interrupt_at = {},
+        .next_scheduled = 0,
+        .interrupt_chance = -1,
+        .generator = nullptr,
+        .next_random = 0,
+        .next_interrupt = 0,
+        .fork_state = &state,
+        .record = nullptr,
+        .locations = locations,
+        .latency = nullptr,
+        .frames = nullptr,
+    };
+
+    const trial_result result = run_trial(bytecode, functions, handler_data, false);
+
+    if (state.is_child) {
+        write_all(state.result_fd, serialize_trial_result(result));
+        close(state.result_fd);
+        fflush(stdout);
+        _exit(0);
+    }
+
+    while (!state.children.empty()) {
+        reap_oldest_child(state);
+    }
+
+    const int num_points = result.num_interrupts;
+    state.results.resize(num_points);
+
+    std::cout << num_points << " total interruption point(s)." << std::endl;
+    std::cout << "Swept " << state.points.size() << " interruption point(s) using up to " << max_children << " process(es)" << std::endl;
+
+    return report_sweep(result, state.results, state.points);
+}
+
+int main(const int argc, char * argv[]) {
     po::options_description desc("Allowed options");
     desc.add_options()
         ("help,h", "print help message")
         ("verbose,v", "verbose output, log interruption points when hit")
         ("interrupt,i", po::value<std::vector<int>>(), "interrupt at interruption point(s)")
         ("interrupt-chance", po::value<double>(), "random chance to interrupt at each interruption point (0-1)")
+        ("seed", po::value<uint32_t>(), "seed for --interrupt-chance, printed before the run when not given")
+        ("record", po::value<std::string>(), "write the points the run is interrupted at to this file as they are taken, for --replay")
+        ("replay", po::value<std::string>(), "interrupt at exactly the points recorded in this file by --record")
+        ("sweep", "interrupt at every interruption point in turn, one trial per point, and report trials which fail to recover")
+        ("fork", "with --sweep, fork a trial process at each interruption point of a single run instead of replaying the script for every trial")
+        ("jobs,j", po::value<unsigned int>(), "number of threads (or processes with --fork) to use for --sweep (default: number of cores)")
+        ("locations,l", "attribute each interruption point to the function and line:col it is hit at, and list the locations and functions with the most points")
+        ("at", po::value<std::vector<std::string>>(), "with --sweep, only interrupt at points whose location (see --locations) contains this text")
+        ("latency", "time the gaps between interrupt polls and list the longest with the points and locations they start and end at")
+        ("max-gap", po::value<double>(), "with --latency, exit with code 1 if a gap is longer than this many milliseconds")
+        ("top", po::value<unsigned int>()->default_value(20), "number of locations, functions or gaps to list")
         ("call,c", po::value<std::vector<std::string>>(), "function(s) to call after evaluating the script")
         ("file,f", po::value<std::string>(), "input file containing code");
     po::variables_map vm;
@@ -81,6 +951,50 @@ int main(const int argc, char * argv[]) {
         return 1;
     }
 
+    if (vm.contains("sweep") && (vm.contains("interrupt") || vm.contains("interrupt-chance") || verbose || vm.contains("latency")
+                                 || vm.contains("record") || vm.contains("replay"))) {
+        std::cerr << "--sweep cannot be combined with -i, --interrupt-chance, -v, --latency, --record or --replay. Exiting." << std::endl;
+        return 1;
+    }
+
+    if (vm.contains("replay") && (vm.contains("interrupt") || vm.contains("interrupt-chance"))) {
+        std::cerr << "--replay cannot be combined with -i or --interrupt-chance. Exiting." << std::endl;
+        return 1;
+    }
+
+    if (vm.contains("interrupt-chance")) {
+        const double chance = vm["interrupt-chance"].as<double>();
+        if (!std::isfinite(chance) || chance < 0 || chance > 1) {
+            std::cerr << "--interrupt-chance must be between 0 and 1. Exiting." << std::endl;
+            return 1;
+        }
+        // 1 - chance rounding to 1 would make the number of points skipped infinite
+        if (chance > 0 && 1.0 - chance == 1.0) {
+            std::cerr << "--interrupt-chance is too small to draw from, use 0 to never interrupt. Exiting." << std::endl;
+            return 1;
+        }
+    }
+
+    if (vm.contains("seed") && !vm.contains("interrupt-chance")) {
+        std::cerr << "--seed can only be used with --interrupt-chance. Exiting." << std::endl;
+        return 1;
+    }
+
+    if (vm.contains("max-gap") && !vm.contains("latency")) {
+        std::cerr << "--max-gap can only be used with --latency. Exiting." << std::endl;
+        return 1;
+    }
+
+    if (vm.contains("fork") && !vm.contains("sweep")) {
+        std::cerr << "--fork can only be used with --sweep. Exiting." << std::endl;
+        return 1;
+    }
+
+    if (vm.contains("at") && !vm.contains("sweep")) {
+        std::cerr << "--at can only be used with --sweep. Exiting." << std::endl;
+        return 1;
+    }
+
     if (verbose) {
         std::cout << "Running in verbose mode" << std::endl;
     }
@@ -92,6 +1006,23 @@ int main(const int argc, char * argv[]) {
         interrupt_at.insert(interrupt_at_vec.begin(), interrupt_at_vec.end());
     }
 
+    if (vm.contains("replay")) {
+        const std::string replay_filename = vm["replay"].as<std::string>();
+        std::vector<int> replay_points;
+        if (!read_replay_log(replay_filename, replay_points)) {
+            std::cerr << "Failed to read replay log " << replay_filename << std::endl;
+            return 1;
+        }
+        interrupt_at.insert(replay_points.begin(), replay_points.end());
+    }
+
+    // Print the seed before running, so a run which crashes can still be repeated
+    const uint32_t seed = vm.contains("seed") ? vm["seed"].as<uint32_t>() : std::random_device()();
+    std::mt19937 mt(seed);
+    if (vm.contains("interrupt-chance")) {
+        std::cout << "Seed: " << seed << std::endl;
+    }
+
     std::string filename = vm["file"].as<std::string>();
     std::ifstream file;
     file.open(filename);
@@ -104,60 +1035,99 @@ int main(const int argc, char * argv[]) {
     std::string code = read_ifstream(&file);
     file.close();
 
-    JSRuntime* rt = JS_NewRuntime();
-    JSContext* ctx = JS_NewContext(rt);
-    js_std_add_helpers(ctx, 0, nullptr);
+    std::vector<uint8_t> bytecode;
+    if (!compile_script(code, filename, bytecode)) {
+        return 1;
+    }
+
+    std::vector<std::string> functions;
+    if (vm.contains("call")) {
+        functions = vm["call"].as<std::vector<std::string>>();
+    }
+
+    // Selecting points by location needs the locations of the uninterrupted run
+    const bool record_locations = vm.contains("locations") || vm.contains("at");
+    location_histogram locations;
+    locations.keep_point_locations = vm.contains("sweep") && !vm.contains("fork");
+    if (vm.contains("at")) {
+        locations.filters = vm["at"].as<std::vector<std::string>>();
+    }
+    const unsigned int top = vm["top"].as<unsigned int>();
+
+    if (vm.contains("sweep")) {
+        const unsigned int num_threads = vm.contains("jobs") ? vm["jobs"].as<unsigned int>() : default_thread_count();
+        location_histogram * sweep_locations = record_locations ? &locations : nullptr;
+        const int failures = vm.contains("fork")
+            ? sweep_fork(bytecode, functions, num_threads == 0 ? 1 : num_threads, sweep_locations)
+            : sweep(bytecode, functions, num_threads == 0 ? 1 : num_threads, sweep_locations);
+        if (vm.contains("locations")) {
+            write_location_histogram(locations, top);
+        }
+        return failures > 0 ? 1 : 0;
+    }
+
+    poll_latency latency{
+        .last_poll = {},
+        .histogram = {},
+        .max_slow_gaps = top,
+        .slow_gaps = {},
+        .last_location = -1,
+    };
+
+    replay_log_writer record{
+        .file = nullptr,
+        .last_point = -1,
+    };
+    if (vm.contains("record")) {
+        const std::string record_filename = vm["record"].as<std::string>();
+        if (!open_replay_log(record_filename, record)) {
+            std::cerr << "Failed to open replay log " << record_filename << std::endl;
+            if (record.file != nullptr) fclose(record.file);
+            return 1;
+        }
+    }
 
     interrupt_handler_data handler_data{
         .suppress = false,
         .verbose = verbose,
         .num_interrupts = 0,
-        .interrupt_at = interrupt_at,
+        .interrupt_at = std::vector<int>(interrupt_at.begin(), interrupt_at.end()),
+        .next_scheduled = 0,
         .interrupt_chance = vm.contains("interrupt-chance") ? vm["interrupt-chance"].as<double>() : 0,
         .generator = &mt,
-        .random_distribution = &dist,
+        .next_random = 0,
+        .next_interrupt = 0,
+        .fork_state = nullptr,
+        .record = record.file != nullptr ? &record : nullptr,
+        .locations = record_locations ? &locations : nullptr,
+        .latency = vm.contains("latency") ? &latency : nullptr,
+        .frames = nullptr,
     };
 
-    JS_SetInterruptHandler(rt, interrupt_handler, &handler_data);
-
-    const JSValue val = JS_Eval(ctx, code.c_str(), code.length(), filename.c_str(), JS_EVAL_TYPE_GLOBAL);
+    const trial_result result = run_trial(bytecode, functions, handler_data, true);
 
-    if (vm.contains("call")) {
-        JSValue global = JS_GetGlobalObject(ctx);
+    if (record.file != nullptr && fclose(record.file) != 0) {
+        std::cerr << "Failed to write to the replay log" << std::endl;
+    }
 
-        std::vector<std::string> functions = vm["call"].as<std::vector<std::string>>();
+    std::cout << result.num_interrupts << " total interruption point(s)." << std::endl;
 
-        for (const auto& function : functions) {
-            JSAtom function_atom = JS_NewAtom(ctx, function.c_str());
-            JSValue function_value = JS_GetProperty(ctx, global, function_atom);
+    if (vm.contains("locations")) {
+        write_location_histogram(locations, top);
+    }
 
-            const JSValue return_val = JS_Call(ctx, function_value, function_value, 0, nullptr);
+    if (vm.contains("latency")) {
+        const double max_gap_ms = write_poll_latency(latency);
 
-            if (JS_IsException(return_val)) {
-                handler_data.suppress = true;
-                js_std_dump_error(ctx);
-                handler_data.suppress = false;
+        if (vm.contains("max-gap")) {
+            const double limit_ms = vm["max-gap"].as<double>();
+            if (max_gap_ms > limit_ms) {
+                std::cerr << std::format("Longest gap between interrupt polls is {:.3f} ms, over the limit of {} ms",
+                                         max_gap_ms, limit_ms) << std::endl;
+                return 1;
             }
-
-            JS_FreeAtom(ctx, function_atom);
-            JS_FreeValue(ctx, function_value);
-            JS_FreeValue(ctx, return_val);
         }
-
-        JS_FreeValue(ctx, global);
-    }
-
-    if (JS_IsException(val)) {
-        handler_data.suppress = true;
-        js_std_dump_error(ctx);
-        handler_data.suppress = false;
     }
 
-    JS_FreeValue(ctx, val);
-
-    std::cout << handler_data.num_interrupts << " total interruption point(s)." << std::endl;
-
-    JS_FreeContext(ctx);
-    JS_FreeRuntime(rt);
     return 0;
 }
\ No newline at end of file
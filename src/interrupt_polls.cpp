@@ -0,0 +1,145 @@
+#include "interrupt_polls.h"
+#include <algorithm>
+#include <deque>
+
+#include "instruction_decoder.h"
+
+poll_kind instruction_poll_kind(const opcode op) {
+    switch (op) {
+        // The branch handlers of JS_CallInternal poll after moving pc
+        case op_goto:
+        case op_goto16:
+        case op_goto8:
+        case op_if_true:
+        case op_if_false:
+        case op_if_true8:
+        case op_if_false8:
+        // JS_CallInternal and JS_CallConstructorInternal poll before anything else, for C functions as well
+        case op_call:
+        case op_call0:
+        case op_call1:
+        case op_call2:
+        case op_call3:
+        case op_tail_call:
+        case op_call_method:
+        case op_tail_call_method:
+        case op_call_constructor:
+        case op_apply:
+        case op_eval:
+        case op_apply_eval:
+        // The function is resumed through JS_CallInternal
+        case op_initial_yield:
+        case op_yield:
+        case op_yield_star:
+        case op_async_yield_star:
+        case op_await:
+            return poll_kind::always;
+        // Calls the iterator's methods, which a finished iterator skips
+        case op_for_of_start:
+        case op_for_await_of_start:
+        case op_for_of_next:
+        case op_iterator_next:
+        case op_iterator_call:
+        case op_iterator_close:
+        case op_append:
+        // Polls at each step up the prototype chain
+        case op_instanceof:
+        case op_for_in_start:
+            return poll_kind::may;
+        default:
+            return poll_kind::none;
+    }
+}
+
+// The longest stretch running up to an instruction
+struct open_stretch {
+    uint32_t start;
+    uint32_t instruction_count;
+};
+
+poll_map map_interrupt_polls(const JSFunctionBytecode * b, const control_flow_graph & cfg) {
+    poll_map map;
+    const auto block_count = static_cast<uint32_t>(cfg.blocks.size());
+
+    // Blocks are visited once every block falling into them without a poll is done, so the stretch entering
+    // a block is the longest one. Edges out of a block ending with a poll start a new stretch instead.
+    std::vector<bool> ends_with_poll(block_count, false);
+    for (uint32_t i = 0; i < block_count; i++) {
+        const basic_block & block = cfg.blocks[i];
+        ends_with_poll[i] = instruction_poll_kind(decode_instruction(b, block.last).info->id) == poll_kind::always;
+    }
+
+    std::vector<uint32_t> open_predecessors(block_count, 0);
+    for (uint32_t i = 0; i < block_count; i++) {
+        if (!cfg.blocks[i].reachable || ends_with_poll[i]) continue;
+        for (const uint32_t successor : cfg.blocks[i].successors) open_predecessors[successor]++;
+    }
+
+    std::vector<open_stretch> entering(block_count, open_stretch{0, 0});
+    std::vector<bool> done(block_count, false);
+    std::deque<uint32_t> ready;
+
+    for (uint32_t i = 0; i < block_count; i++) {
+        entering[i].start = cfg.blocks[i].start;
+        if (cfg.blocks[i].reachable && open_predecessors[i] == 0) ready.push_back(i);
+    }
+
+    auto visit = [&](const uint32_t index) {
+        const basic_block & block = cfg.blocks[index];
+        open_stretch current = entering[index];
+        done[index] = true;
+
+        for (uint32_t pos = block.start; pos < block.end;) {
+            const decoded_instruction insn = decode_instruction(b, pos);
+            const poll_kind kind = instruction_poll_kind(insn.info->id);
+
+            if (current.instruction_count == 0) current.start = pos;
+            current.instruction_count++;
+
+            if (kind == poll_kind::may) map.may_sites++;
+            if (kind == poll_kind::always) {
+                map.always_sites++;
+                map.stretches.push_back({current.start, pos, current.instruction_count});
+                current.instruction_count = 0;
+            }
+
+            pos += insn.info->size;
+        }
+
+        if (ends_with_poll[index]) return;
+
+        if (block.successors.empty()) {
+            map.stretches.push_back({current.start, block.last, current.instruction_count});
+            return;
+        }
+
+        for (const uint32_t successor : block.successors) {
+            if (current.instruction_count > entering[successor].instruction_count) {
+                entering[successor] = current;
+            }
+            if (--open_predecessors[successor] == 0) ready.push_back(successor);
+        }
+    };
+
+    for (;;) {
+        while (!ready.empty()) {
+            const uint32_t index = ready.front();
+            ready.pop_front();
+            if (!done[index]) visit(index);
+        }
+
+        // Whatever is left is on a cycle of blocks without a poll. Continue from its first block with the
+        // longest stretch found so far, so the rest of the function is still mapped.
+        uint32_t left = 0;
+        while (left < block_count && (!cfg.blocks[left].reachable || done[left])) left++;
+        if (left == block_count) break;
+
+        map.unbounded = true;
+        ready.push_back(left);
+    }
+
+    std::stable_sort(map.stretches.begin(), map.stretches.end(), [](const poll_stretch & x, const poll_stretch & y) {
+        return x.instruction_count > y.instruction_count;
+    });
+    return map;
+}
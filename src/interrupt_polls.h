@@ -0,0 +1,45 @@
+#ifndef INTERRUPT_POLLS_H
+#define INTERRUPT_POLLS_H
+#include <cstdint>
+#include <vector>
+
+#include "control_flow.h"
+#include "opcodes.h"
+#include "quickjs_bytecode.h"
+
+// Whether executing an instruction calls js_poll_interrupts, the only place the interrupt handler runs
+enum class poll_kind : uint8_t {
+    none,
+    // Only when the instruction ends up calling a function or walking a prototype chain, such as an iterator's
+    // next method or instanceof
+    may,
+    // Every time: jumps and branches poll whether taken or not, calls poll on entering the callee, and await
+    // and yield poll when the function is resumed
+    always,
+};
+
+poll_kind instruction_poll_kind(opcode op);
+
+// Instructions which run one after another without an instruction that always polls in between. A stretch
+// starts at the function's entry or after a poll, and ends with the next poll or where the function returns.
+struct poll_stretch {
+    uint32_t start;
+    // Offset of the last instruction, included in the stretch
+    uint32_t end;
+    uint32_t instruction_count;
+};
+
+struct poll_map {
+    uint32_t always_sites = 0;
+    uint32_t may_sites = 0;
+    // The longest stretch ending at each poll and return, longest first
+    std::vector<poll_stretch> stretches;
+    // Some loop does not contain an instruction that always polls, so it can run without ever polling
+    bool unbounded = false;
+};
+
+// Finds the poll sites of the function and the longest stretches between them, following the edges of the
+// control flow graph. Exceptions are only followed from the catch instruction, and ret ends a stretch.
+poll_map map_interrupt_polls(const JSFunctionBytecode * b, const control_flow_graph & cfg);
+
+#endif //INTERRUPT_POLLS_H
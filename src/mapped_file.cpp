@@ -0,0 +1,57 @@
+#include "mapped_file.h"
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+mapped_file::~mapped_file() {
+    close();
+}
+
+bool mapped_file::open(const std::string & filename, std::string & error) {
+    close();
+
+    const int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        error = "Failed to open file " + filename + ": " + strerror(errno);
+        return false;
+    }
+
+    struct stat info{};
+    if (fstat(fd, &info) != 0) {
+        error = "Failed to read file " + filename + ": " + strerror(errno);
+        ::close(fd);
+        return false;
+    }
+
+    // mmap rejects empty mappings
+    if (info.st_size == 0) {
+        error = "File " + filename + " is empty";
+        ::close(fd);
+        return false;
+    }
+
+    void * mapping = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    const int mmap_errno = errno;
+    ::close(fd);
+
+    if (mapping == MAP_FAILED) {
+        error = "Failed to map file " + filename + ": " + strerror(mmap_errno);
+        return false;
+    }
+
+    address = mapping;
+    length = info.st_size;
+    return true;
+}
+
+void mapped_file::close() {
+    if (address != nullptr) {
+        munmap(address, length);
+        address = nullptr;
+        length = 0;
+    }
+}
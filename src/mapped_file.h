@@ -0,0 +1,32 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Read-only memory mapping of a whole file, so its contents can be used without reading them into a buffer first
+class mapped_file {
+public:
+    mapped_file() = default;
+    ~mapped_file();
+
+    mapped_file(const mapped_file &) = delete;
+    mapped_file & operator=(const mapped_file &) = delete;
+
+    // Maps the file, replacing any previous mapping. Returns false and sets error if it can't be mapped.
+    bool open(const std::string & filename, std::string & error);
+
+    const uint8_t * data() const { return static_cast<const uint8_t *>(address); }
+    size_t size() const { return length; }
+
+    std::string_view text() const { return {static_cast<const char *>(address), length}; }
+
+private:
+    void close();
+
+    void * address = nullptr;
+    size_t length = 0;
+};
+
+#endif //MAPPED_FILE_H
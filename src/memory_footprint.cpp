@@ -0,0 +1,25 @@
+#include "memory_footprint.h"
+
+void memory_footprint::add_function(const JSFunctionBytecode * b) {
+    functions++;
+    header += sizeof(JSFunctionBytecode);
+    bytecode += b->byte_code_len;
+    cpool += b->cpool_count * sizeof(JSValue);
+    vardefs += b->vardefs ? (b->arg_count + b->var_count) * sizeof(JSVarDef) : 0;
+    closure_vars += b->closure_var_count * sizeof(JSClosureVar);
+    pc2line += b->pc2line_buf ? b->pc2line_len : 0;
+    source += b->source ? b->source_len : 0;
+}
+
+memory_footprint & memory_footprint::operator+=(const memory_footprint & other) {
+    functions += other.functions;
+    header += other.header;
+    bytecode += other.bytecode;
+    cpool += other.cpool;
+    vardefs += other.vardefs;
+    closure_vars += other.closure_vars;
+    pc2line += other.pc2line;
+    source += other.source;
+    serialized += other.serialized;
+    return *this;
+}
@@ -0,0 +1,33 @@
+#ifndef MEMORY_FOOTPRINT_H
+#define MEMORY_FOOTPRINT_H
+#include <cstdint>
+
+#include "quickjs_bytecode.h"
+
+// Bytes held by compiled functions, split the way js_create_function and JS_ReadObject allocate them:
+// the JSFunctionBytecode with its constant pool, variable tables and bytecode in one block, and the
+// pc2line table and source text in blocks of their own. Atoms and allocator overhead are not counted.
+struct memory_footprint {
+    uint64_t functions = 0;
+    uint64_t header = 0;
+    uint64_t bytecode = 0;
+    uint64_t cpool = 0;
+    uint64_t vardefs = 0;
+    uint64_t closure_vars = 0;
+    uint64_t pc2line = 0;
+    uint64_t source = 0;
+
+    // Size of the functions written by JS_WriteObject, when they were serialized
+    uint64_t serialized = 0;
+
+    // Adds the function, but not the functions nested in it
+    void add_function(const JSFunctionBytecode * b);
+
+    uint64_t total() const {
+        return header + bytecode + cpool + vardefs + closure_vars + pc2line + source;
+    }
+
+    memory_footprint & operator+=(const memory_footprint & other);
+};
+
+#endif //MEMORY_FOOTPRINT_H
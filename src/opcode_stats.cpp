@@ -0,0 +1,107 @@
+#include "opcode_stats.h"
+#include <algorithm>
+#include <numeric>
+#include <vector>
+
+void opcode_stats::add_function(const JSFunctionBytecode * b) {
+    functions++;
+
+    for (uint32_t pos = 0; pos < static_cast<uint32_t>(b->byte_code_len);) {
+        const instruction & info = get_instruction(b->byte_code_buf[pos]);
+
+        instructions++;
+        opcodes[info.id]++;
+        formats[info.format]++;
+        sizes[info.size]++;
+
+        pos += info.size;
+    }
+
+    bytes += b->byte_code_len;
+}
+
+opcode_stats & opcode_stats::operator+=(const opcode_stats & other) {
+    functions += other.functions;
+    instructions += other.instructions;
+    bytes += other.bytes;
+
+    for (size_t i = 0; i < opcodes.size(); i++) opcodes[i] += other.opcodes[i];
+    for (size_t i = 0; i < formats.size(); i++) formats[i] += other.formats[i];
+    for (size_t i = 0; i < sizes.size(); i++) sizes[i] += other.sizes[i];
+
+    return *this;
+}
+
+// Indices of the non-zero counts, largest count first
+template <size_t N>
+static std::vector<size_t> by_count(const std::array<uint64_t, N> & counts) {
+    std::vector<size_t> order(N);
+    std::iota(order.begin(), order.end(), 0);
+    std::erase_if(order, [&](const size_t i) { return counts[i] == 0; });
+    std::stable_sort(order.begin(), order.end(), [&](const size_t a, const size_t b) {
+        return counts[a] > counts[b];
+    });
+    return order;
+}
+
+static double percent(const uint64_t count, const uint64_t total) {
+    return total == 0 ? 0.0 : 100.0 * static_cast<double>(count) / static_cast<double>(total);
+}
+
+void write_stats_text(output_writer & out, const opcode_stats & stats) {
+    out.format("Functions: {}, instructions: {}, bytecode: {} bytes\n", stats.functions, stats.instructions, stats.bytes);
+
+    out.write("\nOpcodes:\n");
+    out.format("{:>12} {:>7} {:>12}  {}\n", "count", "%", "bytes", "opcode");
+    for (const size_t op : by_count(stats.opcodes)) {
+        const instruction & info = instructions[op];
+        out.format("{:>12} {:>6.2f}% {:>12}  {}\n", stats.opcodes[op], percent(stats.opcodes[op], stats.instructions),
+                   stats.opcodes[op] * info.size, info.name);
+    }
+
+    out.write("\nOperand formats:\n");
+    out.format("{:>12} {:>7}  {}\n", "count", "%", "format");
+    for (const size_t format : by_count(stats.formats)) {
+        out.format("{:>12} {:>6.2f}%  {}\n", stats.formats[format], percent(stats.formats[format], stats.instructions),
+                   operand_format_names[format]);
+    }
+
+    out.write("\nInstruction sizes:\n");
+    out.format("{:>12} {:>7}  {}\n", "count", "%", "size");
+    for (size_t size = 0; size < stats.sizes.size(); size++) {
+        if (stats.sizes[size] == 0) continue;
+        out.format("{:>12} {:>6.2f}%  {} byte(s)\n", stats.sizes[size], percent(stats.sizes[size], stats.instructions), size);
+    }
+}
+
+void write_stats_json(output_writer & out, const opcode_stats & stats) {
+    out.format("{{\"functions\":{},\"instructions\":{},\"bytes\":{},\"opcodes\":{{", stats.functions, stats.instructions, stats.bytes);
+
+    bool first = true;
+    for (const size_t op : by_count(stats.opcodes)) {
+        if (!first) out.put(',');
+        first = false;
+        out.json_string(instructions[op].name);
+        out.format(":{}", stats.opcodes[op]);
+    }
+
+    out.write("},\"formats\":{");
+    first = true;
+    for (const size_t format : by_count(stats.formats)) {
+        if (!first) out.put(',');
+        first = false;
+        out.json_string(operand_format_names[format]);
+        out.format(":{}", stats.formats[format]);
+    }
+
+    out.write("},\"sizes\":{");
+    first = true;
+    for (size_t size = 0; size < stats.sizes.size(); size++) {
+        if (stats.sizes[size] == 0) continue;
+        if (!first) out.put(',');
+        first = false;
+        out.format("\"{}\":{}", size, stats.sizes[size]);
+    }
+
+    out.write("}}\n");
+}
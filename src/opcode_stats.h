@@ -0,0 +1,32 @@
+#ifndef OPCODE_STATS_H
+#define OPCODE_STATS_H
+#include <array>
+#include <cstdint>
+
+#include "opcodes.h"
+#include "output_writer.h"
+#include "quickjs_bytecode.h"
+
+// Static instruction counts of a set of functions, by opcode, operand format and instruction size
+struct opcode_stats {
+    uint64_t functions = 0;
+    uint64_t instructions = 0;
+    uint64_t bytes = 0;
+
+    std::array<uint64_t, op_count> opcodes{};
+    std::array<uint64_t, fmt_count> formats{};
+    std::array<uint64_t, MAX_INSTRUCTION_SIZE + 1> sizes{};
+
+    // Counts the instructions of the function, but not of the functions nested in it
+    void add_function(const JSFunctionBytecode * b);
+
+    opcode_stats & operator+=(const opcode_stats & other);
+};
+
+// Writes tables of the counts, most frequent first
+void write_stats_text(output_writer & out, const opcode_stats & stats);
+
+// Writes the counts as a single JSON object
+void write_stats_json(output_writer & out, const opcode_stats & stats);
+
+#endif //OPCODE_STATS_H
@@ -0,0 +1,74 @@
+#ifndef OPCODES_H
+#define OPCODES_H
+#include <cstdint>
+#include <iterator>
+#include <string_view>
+
+// Opcode metadata generated from quickjs-opcode.h. Temporary opcodes (lowercase def) never
+// appear in final bytecode and are left out, so opcode values match the engine's OPCodeEnum.
+
+enum operand_format : uint8_t {
+#define FMT(f) fmt_##f,
+#include "quickjs-opcode.h"
+    fmt_count,
+};
+
+inline constexpr std::string_view operand_format_names[] = {
+#define FMT(f) #f,
+#include "quickjs-opcode.h"
+};
+
+static_assert(std::size(operand_format_names) == fmt_count);
+
+enum opcode : uint8_t {
+#define DEF(ID, SIZE, N_POP, N_PUSH, F) op_##ID,
+#define def(id, size, n_pop, n_push, f)
+#include "quickjs-opcode.h"
+    op_count,
+};
+
+struct instruction {
+    std::string_view name;
+    opcode id;
+    uint8_t size;
+    uint8_t n_pop;
+    uint8_t n_push;
+    operand_format format;
+};
+
+inline constexpr instruction instructions[] = {
+#define DEF(ID, SIZE, N_POP, N_PUSH, F) \
+    {                                   \
+        .name = #ID,                    \
+        .id = op_##ID,                  \
+        .size = SIZE,                   \
+        .n_pop = N_POP,                 \
+        .n_push = N_PUSH,               \
+        .format = fmt_##F               \
+    },
+#define def(id, size, n_pop, n_push, f)
+#include "quickjs-opcode.h"
+};
+
+static_assert(std::size(instructions) == op_count);
+
+inline constexpr uint8_t MAX_INSTRUCTION_SIZE = [] {
+    uint8_t size = 0;
+    for (const auto & info : instructions) {
+        if (info.size > size) size = info.size;
+    }
+    return size;
+}();
+
+// Compact forms the compiler substitutes for common instructions, such as get_loc0 for get_loc 0.
+// They all follow nop, the last of the long opcodes.
+constexpr bool is_short_opcode(const opcode op) {
+    return op > op_nop;
+}
+
+// Bytes outside the opcode range decode as op_invalid, which is one byte long
+constexpr const instruction & get_instruction(const uint8_t op) {
+    return op < op_count ? instructions[op] : instructions[op_invalid];
+}
+
+#endif //OPCODES_H
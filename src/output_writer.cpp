@@ -0,0 +1,78 @@
+#include "output_writer.h"
+
+// Indentation is copied out of one preallocated run of spaces rather than built per line
+static const std::string INDENT_SPACES(256, ' ');
+
+output_writer::output_writer(FILE * file, const size_t buffer_size)
+    : file(file), flush_threshold(buffer_size), failed(false) {
+    // Leave headroom so a single record rarely has to grow the buffer past its threshold
+    buffer.reserve(buffer_size + buffer_size / 4);
+}
+
+output_writer::output_writer()
+    : file(nullptr), flush_threshold(0), failed(false) {
+}
+
+output_writer::~output_writer() {
+    flush();
+}
+
+void output_writer::indent(const int level) {
+    size_t width = static_cast<size_t>(level) * INDENT_WIDTH;
+
+    while (width > INDENT_SPACES.size()) {
+        buffer.append(INDENT_SPACES);
+        width -= INDENT_SPACES.size();
+    }
+
+    buffer.append(INDENT_SPACES, 0, width);
+}
+
+void output_writer::json_string(const std::string_view text) {
+    static constexpr char HEX_DIGITS[] = "0123456789abcdef";
+
+    buffer.push_back('"');
+
+    for (const char c : text) {
+        switch (c) {
+            case '"': buffer.append("\\\""); break;
+            case '\\': buffer.append("\\\\"); break;
+            case '\n': buffer.append("\\n"); break;
+            case '\r': buffer.append("\\r"); break;
+            case '\t': buffer.append("\\t"); break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    buffer.append("\\u00");
+                    buffer.push_back(HEX_DIGITS[c >> 4]);
+                    buffer.push_back(HEX_DIGITS[c & 0xf]);
+                } else {
+                    buffer.push_back(c);
+                }
+                break;
+        }
+    }
+
+    buffer.push_back('"');
+    flush_if_full();
+}
+
+void output_writer::flush() {
+    if (file == nullptr) return;
+
+    if (!buffer.empty()) {
+        if (std::fwrite(buffer.data(), 1, buffer.size(), file) != buffer.size()) {
+            failed = true;
+        }
+        buffer.clear();
+    }
+
+    if (std::fflush(file) != 0) {
+        failed = true;
+    }
+}
+
+std::string output_writer::take() {
+    std::string result;
+    result.swap(buffer);
+    return result;
+}
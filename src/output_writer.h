@@ -0,0 +1,70 @@
+#ifndef OUTPUT_WRITER_H
+#define OUTPUT_WRITER_H
+#include <cstdio>
+#include <format>
+#include <iterator>
+#include <string>
+#include <string_view>
+
+constexpr int INDENT_WIDTH = 2;
+
+// Formats output into a large reusable buffer which is written to the file in big chunks,
+// instead of going through an ostream call (and possibly a flush) per token.
+class output_writer {
+public:
+    static constexpr size_t DEFAULT_BUFFER_SIZE = 1 << 20;
+
+    explicit output_writer(FILE * file, size_t buffer_size = DEFAULT_BUFFER_SIZE);
+    // Keeps all output in memory until it is taken with take()
+    output_writer();
+    ~output_writer();
+
+    output_writer(const output_writer &) = delete;
+    output_writer & operator=(const output_writer &) = delete;
+
+    void write(std::string_view text) {
+        buffer.append(text);
+        flush_if_full();
+    }
+
+    void put(const char character) {
+        buffer.push_back(character);
+    }
+
+    template <typename... Args>
+    void format(std::format_string<Args...> fmt, Args &&... args) {
+        std::format_to(std::back_inserter(buffer), fmt, std::forward<Args>(args)...);
+        flush_if_full();
+    }
+
+    // Writes the prefix for the given nesting level
+    void indent(int level);
+
+    // Writes text as a quoted JSON string
+    void json_string(std::string_view text);
+
+    void newline() {
+        buffer.push_back('\n');
+        flush_if_full();
+    }
+
+    void flush();
+
+    // Returns the buffered output of an in-memory writer and leaves it empty
+    std::string take();
+
+    // False if any write to the file failed
+    bool good() const { return !failed; }
+
+private:
+    void flush_if_full() {
+        if (file != nullptr && buffer.size() >= flush_threshold) flush();
+    }
+
+    FILE * file;
+    std::string buffer;
+    size_t flush_threshold;
+    bool failed;
+};
+
+#endif //OUTPUT_WRITER_H
@@ -0,0 +1,76 @@
+#include "pc2line_reader.h"
+
+// Encoding constants from quickjs.c
+constexpr int PC2LINE_BASE = -1;
+constexpr int PC2LINE_RANGE = 5;
+constexpr int PC2LINE_OP_FIRST = 1;
+
+static bool read_leb128(const uint8_t *& p, const uint8_t * end, uint32_t & value) {
+    value = 0;
+    for (int i = 0; i < 5 && p < end; i++) {
+        const uint8_t byte = *p++;
+        value |= static_cast<uint32_t>(byte & 0x7f) << (i * 7);
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+static bool read_sleb128(const uint8_t *& p, const uint8_t * end, int32_t & value) {
+    uint32_t raw;
+    if (!read_leb128(p, end, raw)) return false;
+    value = static_cast<int32_t>((raw >> 1) ^ -(raw & 1));
+    return true;
+}
+
+pc2line_reader::pc2line_reader(const JSFunctionBytecode * b)
+    : p(b->pc2line_buf),
+      end(b->pc2line_buf ? b->pc2line_buf + b->pc2line_len : nullptr),
+      current{b->line_num, b->col_num},
+      next_pc(0),
+      next{},
+      has_next(false) {
+    // Without a table (stripped debug information) find_line_num reports the function's line and column 1
+    if (p == nullptr) {
+        current.col = 1;
+    }
+
+    has_next = read_entry();
+}
+
+bool pc2line_reader::read_entry() {
+    if (p == nullptr || p >= end) return false;
+
+    const uint8_t op = *p++;
+    uint32_t pc = next_pc;
+    int line = has_next ? next.line : current.line;
+    const int col = has_next ? next.col : current.col;
+
+    if (op == 0) {
+        uint32_t pc_diff;
+        int32_t line_diff;
+        if (!read_leb128(p, end, pc_diff) || !read_sleb128(p, end, line_diff)) return false;
+        pc += pc_diff;
+        line += line_diff;
+    } else {
+        const int value = op - PC2LINE_OP_FIRST;
+        pc += value / PC2LINE_RANGE;
+        line += value % PC2LINE_RANGE + PC2LINE_BASE;
+    }
+
+    int32_t col_diff;
+    if (!read_sleb128(p, end, col_diff)) return false;
+
+    next_pc = pc;
+    next = {line, col + col_diff};
+    return true;
+}
+
+source_position pc2line_reader::at(const uint32_t pc) {
+    while (has_next && next_pc <= pc) {
+        const source_position reached = next;
+        has_next = read_entry();
+        current = reached;
+    }
+
+    return current;
+}
@@ -0,0 +1,33 @@
+#ifndef PC2LINE_READER_H
+#define PC2LINE_READER_H
+#include <cstdint>
+
+#include "quickjs_bytecode.h"
+
+struct source_position {
+    int line;
+    int col;
+};
+
+// Decodes a function's pc2line table in a single forward pass, the same way find_line_num in
+// quickjs.c does, but without restarting from the beginning of the table for every lookup
+class pc2line_reader {
+public:
+    explicit pc2line_reader(const JSFunctionBytecode * b);
+
+    // Source position of the instruction at pc. Successive calls must not decrease pc.
+    source_position at(uint32_t pc);
+
+private:
+    bool read_entry();
+
+    const uint8_t * p;
+    const uint8_t * end;
+
+    source_position current;
+    uint32_t next_pc;
+    source_position next;
+    bool has_next;
+};
+
+#endif //PC2LINE_READER_H
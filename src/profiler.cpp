@@ -0,0 +1,357 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <boost/program_options.hpp>
+
+#include "quickjs-libc.h"
+#include "quickjs.h"
+#include "output_writer.h"
+#include "utilities.h"
+
+namespace po = boost::program_options;
+
+using profiler_clock = std::chrono::steady_clock;
+
+// Deepest stack recorded by a sample; the outermost frames of deeper stacks are left out
+constexpr int MAX_STACK_DEPTH = 256;
+
+// State shared between the interrupt handler, which takes the samples, and the timer thread asking for them
+struct profiler_state {
+    JSContext * ctx;
+    // The Error constructor, whose stackTraceLimit and prepareStackTrace are set aside while sampling
+    JSValue error_constructor;
+    // Keep the line of each frame in its label instead of only its function and file
+    bool lines;
+
+    // Set by the timer thread, taken by the next interrupt poll
+    std::atomic<bool> sample_due;
+    // Sampling can run JS setters, which poll for interrupts themselves
+    bool sampling;
+
+    // Number of samples of each stack, keyed by its folded frames, outermost first and separated by ';'
+    std::unordered_map<std::string, uint64_t> stacks;
+    uint64_t samples;
+    // Samples with no JS frame or which could not be taken
+    uint64_t dropped;
+    profiler_clock::duration sampling_time;
+};
+
+// Label of a frame, "name (file:line:col)", as the function name followed by its file, and line if requested,
+// in parentheses. ';' separates frames in folded output and is replaced.
+std::string frame_label(const std::string_view frame, const bool lines) {
+    std::string_view name = frame;
+    std::string_view location;
+
+    const size_t open = frame.rfind(" (");
+    if (open != std::string_view::npos && frame.ends_with(')')) {
+        name = frame.substr(0, open);
+        location = frame.substr(open + 2, frame.size() - open - 3);
+
+        // Frames with a position end in :line:col. The column is always dropped, and the line unless requested.
+        const size_t column = location.rfind(':');
+        const size_t line = column == std::string_view::npos ? column : location.rfind(':', column - 1);
+        if (line != std::string_view::npos) {
+            location = location.substr(0, lines ? column : line);
+        }
+    }
+
+    std::string label(name);
+    if (!location.empty()) {
+        label += " (";
+        label += location;
+        label += ')';
+    }
+
+    std::ranges::replace(label, ';', ',');
+    return label;
+}
+
+// Records the JS stack at the current poll
+void take_sample(profiler_state & state) {
+    const auto start = profiler_clock::now();
+    state.sampling = true;
+
+    std::vector<std::string> frames;
+    capture_stack(state.ctx, state.error_constructor, MAX_STACK_DEPTH, frames);
+
+    if (frames.empty()) {
+        state.dropped++;
+    } else {
+        std::string folded;
+        for (auto it = frames.rbegin(); it != frames.rend(); ++it) {
+            if (!folded.empty()) folded += ';';
+            folded += frame_label(*it, state.lines);
+        }
+        state.stacks[folded]++;
+        state.samples++;
+    }
+
+    state.sampling = false;
+    state.sampling_time += profiler_clock::now() - start;
+}
+
+// Runs at every interrupt poll, so unless a sample is due it only checks the flag
+int profiler_interrupt_handler(JSRuntime *, void * opaque) {
+    auto * state = static_cast<profiler_state *>(opaque);
+
+    if (state->sample_due.load(std::memory_order_relaxed) && !state->sampling) {
+        state->sample_due.store(false, std::memory_order_relaxed);
+        take_sample(*state);
+    }
+
+    return 0;
+}
+
+// Evaluates the script, calls the requested functions and runs the jobs they leave behind, such as promise
+// reactions. Returns false if any of them threw, after dumping the error.
+bool run_script(JSContext * ctx, const std::string & code, const std::string & filename,
+                const std::vector<std::string> & functions) {
+    bool success = true;
+
+    const JSValue val = JS_Eval(ctx, code.c_str(), code.length(), filename.c_str(), JS_EVAL_TYPE_GLOBAL);
+    if (JS_IsException(val)) {
+        js_std_dump_error(ctx);
+        success = false;
+    }
+    JS_FreeValue(ctx, val);
+
+    const JSValue global = JS_GetGlobalObject(ctx);
+
+    for (const auto & function : functions) {
+        const JSValue function_value = JS_GetPropertyStr(ctx, global, function.c_str());
+        const JSValue return_val = JS_Call(ctx, function_value, global, 0, nullptr);
+
+        if (JS_IsException(return_val)) {
+            js_std_dump_error(ctx);
+            success = false;
+        }
+
+        JS_FreeValue(ctx, function_value);
+        JS_FreeValue(ctx, return_val);
+    }
+
+    JS_FreeValue(ctx, global);
+
+    JSContext * job_ctx;
+    int job;
+    while ((job = JS_ExecutePendingJob(JS_GetRuntime(ctx), &job_ctx)) != 0) {
+        if (job < 0) {
+            js_std_dump_error(job_ctx);
+            success = false;
+        }
+    }
+
+    return success;
+}
+
+void write_folded_stacks(output_writer & out, const profiler_state & state) {
+    std::vector<std::pair<std::string_view, uint64_t>> stacks(state.stacks.begin(), state.stacks.end());
+    std::ranges::sort(stacks);
+
+    for (const auto & [stack, count] : stacks) {
+        out.format("{} {}\n", stack, count);
+    }
+}
+
+// Lists the functions with the most samples in which they were running, with the samples they were on the
+// stack in. A recursive function is counted once per sample.
+void write_function_table(output_writer & out, const profiler_state & state, const size_t count) {
+    struct function_samples {
+        std::string_view function;
+        uint64_t self = 0;
+        uint64_t total = 0;
+    };
+
+    std::unordered_map<std::string_view, function_samples> functions;
+
+    for (const auto & [stack, samples] : state.stacks) {
+        const std::string_view folded = stack;
+        std::unordered_set<std::string_view> seen;
+        std::string_view leaf;
+
+        for (size_t start = 0; start <= folded.size();) {
+            const size_t end = std::min(folded.find(';', start), folded.size());
+            leaf = folded.substr(start, end - start);
+
+            if (seen.insert(leaf).second) {
+                function_samples & entry = functions[leaf];
+                entry.function = leaf;
+                entry.total += samples;
+            }
+            start = end + 1;
+        }
+
+        functions[leaf].self += samples;
+    }
+
+    std::vector<function_samples> ranking;
+    ranking.reserve(functions.size());
+    for (const auto & [function, entry] : functions) ranking.push_back(entry);
+
+    std::ranges::sort(ranking, [](const function_samples & a, const function_samples & b) {
+        if (a.self != b.self) return a.self > b.self;
+        if (a.total != b.total) return a.total > b.total;
+        return a.function < b.function;
+    });
+
+    const auto percent = [&](const uint64_t samples) {
+        return state.samples == 0 ? 0.0 : 100.0 * static_cast<double>(samples) / static_cast<double>(state.samples);
+    };
+
+    out.format("{:>16}  {:>16}  Function\n", "Self", "Total");
+    for (size_t i = 0; i < std::min(count, ranking.size()); i++) {
+        const function_samples & entry = ranking[i];
+        out.format("{:8} {:6.2f}%  {:8} {:6.2f}%  {}\n",
+                   entry.self, percent(entry.self), entry.total, percent(entry.total), entry.function);
+    }
+}
+
+int main(const int argc, char * argv[]) {
+    po::options_description desc("Allowed options");
+    desc.add_options()
+        ("help,h", "print help message")
+        ("file,f", po::value<std::string>(), "input file containing code")
+        ("call,c", po::value<std::vector<std::string>>(), "function(s) to call after evaluating the script")
+        ("rate,r", po::value<unsigned int>()->default_value(1000), "samples per second")
+        ("folded", po::value<std::string>(), "write the sampled stacks to this file in folded format, for flamegraph.pl and compatible tools")
+        ("lines", "tell frames apart by line as well as by function")
+        ("top", po::value<unsigned int>()->default_value(20), "number of functions to list");
+    po::variables_map vm;
+    try {
+        po::store(po::parse_command_line(argc, argv, desc), vm);
+    }
+    catch (po::error & e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    po::notify(vm);
+
+    if (vm.contains("help")) {
+        std::cout << desc << std::endl;
+        return 1;
+    }
+
+    if (!vm.contains("file")) {
+        std::cerr << "No input file provided with -f. Exiting." << std::endl;
+        return 1;
+    }
+
+    const unsigned int rate = vm["rate"].as<unsigned int>();
+    if (rate == 0) {
+        std::cerr << "--rate must be at least 1. Exiting." << std::endl;
+        return 1;
+    }
+
+    const std::string filename = vm["file"].as<std::string>();
+    std::ifstream file;
+    file.open(filename);
+
+    if (!file.is_open()) {
+        std::cerr << "Failed to open file " << filename << std::endl;
+        return 1;
+    }
+
+    const std::string code = read_ifstream(&file);
+    file.close();
+
+    std::vector<std::string> functions;
+    if (vm.contains("call")) {
+        functions = vm["call"].as<std::vector<std::string>>();
+    }
+
+    JSRuntime * rt = JS_NewRuntime();
+    JSContext * ctx = JS_NewContext(rt);
+    js_std_add_helpers(ctx, 0, nullptr);
+
+    const JSValue global = JS_GetGlobalObject(ctx);
+    profiler_state state{
+        .ctx = ctx,
+        .error_constructor = JS_GetPropertyStr(ctx, global, "Error"),
+        .lines = vm.contains("lines"),
+        .sample_due = false,
+        .sampling = false,
+        .stacks = {},
+        .samples = 0,
+        .dropped = 0,
+        .sampling_time = {},
+    };
+    JS_FreeValue(ctx, global);
+
+    JS_SetInterruptHandler(rt, profiler_interrupt_handler, &state);
+
+    // The timer only raises the flag; the sample is taken by the interpreter's thread at its next poll
+    std::atomic<bool> finished{false};
+    std::thread timer([&] {
+        const auto interval = std::chrono::duration_cast<profiler_clock::duration>(std::chrono::seconds(1)) / rate;
+        auto next = profiler_clock::now();
+
+        while (!finished.load(std::memory_order_relaxed)) {
+            next += interval;
+            std::this_thread::sleep_until(next);
+            state.sample_due.store(true, std::memory_order_relaxed);
+        }
+    });
+
+    const auto start = profiler_clock::now();
+    const bool success = run_script(ctx, code, filename, functions);
+    const auto elapsed = profiler_clock::now() - start;
+
+    finished = true;
+    timer.join();
+    JS_SetInterruptHandler(rt, nullptr, nullptr);
+
+    bool write_ok = true;
+
+    if (vm.contains("folded")) {
+        const std::string folded_filename = vm["folded"].as<std::string>();
+        FILE * folded_file = fopen(folded_filename.c_str(), "wb");
+
+        if (folded_file == nullptr) {
+            std::cerr << "Failed to open output file " << folded_filename << std::endl;
+            write_ok = false;
+        } else {
+            {
+                output_writer out(folded_file);
+                write_folded_stacks(out, state);
+                out.flush();
+                write_ok = out.good();
+            }
+            write_ok = fclose(folded_file) == 0 && write_ok;
+        }
+    }
+
+    {
+        using milliseconds = std::chrono::duration<double, std::milli>;
+        const double run_ms = std::chrono::duration_cast<milliseconds>(elapsed).count();
+        const double sampling_ms = std::chrono::duration_cast<milliseconds>(state.sampling_time).count();
+
+        output_writer out(stdout);
+        out.format("{} sample(s) at {} Hz over {:.1f} ms, {} dropped; sampling took {:.2f} ms ({:.2f}% of the run)\n",
+                   state.samples, rate, run_ms, state.dropped, sampling_ms,
+                   run_ms > 0 ? 100.0 * sampling_ms / run_ms : 0.0);
+        write_function_table(out, state, vm["top"].as<unsigned int>());
+        out.flush();
+        write_ok = out.good() && write_ok;
+    }
+
+    JS_FreeValue(ctx, state.error_constructor);
+    JS_FreeContext(ctx);
+    JS_FreeRuntime(rt);
+
+    if (!write_ok) {
+        std::cerr << "Failed to write output" << std::endl;
+        return 1;
+    }
+
+    return success ? 0 : 1;
+}
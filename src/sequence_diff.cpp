@@ -0,0 +1,106 @@
+#include "sequence_diff.h"
+#include <algorithm>
+
+// Appends the edits turning a[a_start, a_end) into b[b_start, b_end)
+static void diff_middle(const std::vector<std::string> & a, const std::vector<std::string> & b,
+                        const int a_start, const int a_end, const int b_start, const int b_end,
+                        const int max_edits, std::vector<edit> & edits) {
+    const int n = a_end - a_start;
+    const int m = b_end - b_start;
+
+    auto equal = [&](const int x, const int y) { return a[a_start + x] == b[b_start + y]; };
+
+    // v[k + offset] is the furthest x reached on diagonal k = x - y; trace[d] keeps the
+    // diagonals -d..d of v after d edits, which is all the backtracking needs
+    const int offset = n + m + 1;
+    std::vector<int> v(2 * offset + 1, 0);
+    std::vector<std::vector<int>> trace;
+    bool found = false;
+
+    for (int d = 0; d <= std::min(n + m, max_edits) && !found; d++) {
+        for (int k = -d; k <= d; k += 2) {
+            int x = k == -d || (k != d && v[k - 1 + offset] < v[k + 1 + offset])
+                ? v[k + 1 + offset]
+                : v[k - 1 + offset] + 1;
+            int y = x - k;
+
+            while (x < n && y < m && equal(x, y)) {
+                x++;
+                y++;
+            }
+
+            v[k + offset] = x;
+            if (x >= n && y >= m) found = true;
+        }
+
+        trace.emplace_back(v.begin() + offset - d, v.begin() + offset + d + 1);
+    }
+
+    if (!found) {
+        for (int x = 0; x < n; x++) edits.push_back({edit_kind::remove, static_cast<uint32_t>(a_start + x), 0});
+        for (int y = 0; y < m; y++) edits.push_back({edit_kind::insert, 0, static_cast<uint32_t>(b_start + y)});
+        return;
+    }
+
+    std::vector<edit> reversed;
+    int x = n;
+    int y = m;
+
+    auto keep_diagonal = [&](const int to_x, const int to_y) {
+        while (x > to_x && y > to_y) {
+            x--;
+            y--;
+            reversed.push_back({edit_kind::keep, static_cast<uint32_t>(a_start + x), static_cast<uint32_t>(b_start + y)});
+        }
+    };
+
+    for (int d = static_cast<int>(trace.size()) - 1; d > 0; d--) {
+        const std::vector<int> & previous = trace[d - 1];
+        auto at = [&](const int k) { return previous[k + d - 1]; };
+
+        const int k = x - y;
+        const bool inserted = k == -d || (k != d && at(k - 1) < at(k + 1));
+        const int previous_k = inserted ? k + 1 : k - 1;
+        const int previous_x = at(previous_k);
+        const int previous_y = previous_x - previous_k;
+
+        // The snake after the edit starts where the edit left off
+        keep_diagonal(inserted ? previous_x : previous_x + 1, inserted ? previous_y + 1 : previous_y);
+
+        if (inserted) {
+            reversed.push_back({edit_kind::insert, 0, static_cast<uint32_t>(b_start + previous_y)});
+        } else {
+            reversed.push_back({edit_kind::remove, static_cast<uint32_t>(a_start + previous_x), 0});
+        }
+
+        x = previous_x;
+        y = previous_y;
+    }
+
+    keep_diagonal(0, 0);
+    edits.insert(edits.end(), reversed.rbegin(), reversed.rend());
+}
+
+std::vector<edit> diff_sequences(const std::vector<std::string> & a, const std::vector<std::string> & b,
+                                 const uint32_t max_edits) {
+    std::vector<edit> edits;
+    const auto a_size = static_cast<uint32_t>(a.size());
+    const auto b_size = static_cast<uint32_t>(b.size());
+
+    uint32_t prefix = 0;
+    while (prefix < a_size && prefix < b_size && a[prefix] == b[prefix]) prefix++;
+
+    uint32_t suffix = 0;
+    while (suffix < a_size - prefix && suffix < b_size - prefix && a[a_size - 1 - suffix] == b[b_size - 1 - suffix]) {
+        suffix++;
+    }
+
+    for (uint32_t i = 0; i < prefix; i++) edits.push_back({edit_kind::keep, i, i});
+
+    diff_middle(a, b, static_cast<int>(prefix), static_cast<int>(a_size - suffix),
+                static_cast<int>(prefix), static_cast<int>(b_size - suffix), static_cast<int>(max_edits), edits);
+
+    for (uint32_t i = suffix; i > 0; i--) edits.push_back({edit_kind::keep, a_size - i, b_size - i});
+
+    return edits;
+}
@@ -0,0 +1,26 @@
+#ifndef SEQUENCE_DIFF_H
+#define SEQUENCE_DIFF_H
+#include <cstdint>
+#include <string>
+#include <vector>
+
+enum class edit_kind {
+    keep,
+    remove,
+    insert,
+};
+
+struct edit {
+    edit_kind kind;
+    // Index into the old sequence, for keep and remove
+    uint32_t old_index;
+    // Index into the new sequence, for keep and insert
+    uint32_t new_index;
+};
+
+// Shortest edit script turning a into b, using Myers' algorithm on what is left after the common prefix
+// and suffix. Sequences differing by more than max_edits elements are treated as entirely replaced.
+std::vector<edit> diff_sequences(const std::vector<std::string> & a, const std::vector<std::string> & b,
+                                 uint32_t max_edits = 2048);
+
+#endif //SEQUENCE_DIFF_H
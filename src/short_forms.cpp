@@ -0,0 +1,154 @@
+#include "short_forms.h"
+
+#include "instruction_decoder.h"
+
+static bool fits_int8(const int64_t value) {
+    return value >= INT8_MIN && value <= INT8_MAX;
+}
+
+static bool fits_int16(const int64_t value) {
+    return value >= INT16_MIN && value <= INT16_MAX;
+}
+
+static opcode offset_opcode(const opcode first, const int64_t offset) {
+    return static_cast<opcode>(first + offset);
+}
+
+// The one-byte forms of an instruction taking a slot index, first of four, and its one-byte operand form
+struct slot_forms {
+    opcode first;
+    opcode byte_operand;
+};
+
+// Slot forms of op, or op_invalid as first if it has none
+static slot_forms short_slot_forms(const opcode op) {
+    switch (op) {
+        case op_get_loc: return {op_get_loc0, op_get_loc8};
+        case op_put_loc: return {op_put_loc0, op_put_loc8};
+        case op_set_loc: return {op_set_loc0, op_set_loc8};
+        case op_get_loc8: return {op_get_loc0, op_invalid};
+        case op_put_loc8: return {op_put_loc0, op_invalid};
+        case op_set_loc8: return {op_set_loc0, op_invalid};
+        case op_get_arg: return {op_get_arg0, op_invalid};
+        case op_put_arg: return {op_put_arg0, op_invalid};
+        case op_set_arg: return {op_set_arg0, op_invalid};
+        case op_get_var_ref: return {op_get_var_ref0, op_invalid};
+        case op_put_var_ref: return {op_put_var_ref0, op_invalid};
+        case op_set_var_ref: return {op_set_var_ref0, op_invalid};
+        case op_call: return {op_call0, op_invalid};
+        default: return {op_invalid, op_invalid};
+    }
+}
+
+// Smallest of the forms push_short_int picks for the value
+static opcode short_int_form(const int64_t value) {
+    if (value >= -1 && value <= 7) return offset_opcode(op_push_0, value);
+    if (fits_int8(value)) return op_push_i8;
+    if (fits_int16(value)) return op_push_i16;
+    return op_push_i32;
+}
+
+// Smallest jump form the displacement fits, with the jump itself shrunk
+static opcode short_jump_form(const decoded_instruction & insn) {
+    const opcode op = insn.info->id;
+    const int64_t target = label_target(insn);
+    const int64_t operand_pos = insn.pos + 1;
+
+    // Shrinking the jump moves every target after it closer by the bytes saved
+    auto displacement = [&](const opcode form) {
+        const int64_t saved = insn.info->size - get_instruction(form).size;
+        return (target > insn.pos ? target - saved : target) - operand_pos;
+    };
+
+    opcode byte_form;
+    switch (op) {
+        case op_if_false: byte_form = op_if_false8; break;
+        case op_if_true: byte_form = op_if_true8; break;
+        default: byte_form = op_goto8; break;
+    }
+
+    if (fits_int8(displacement(byte_form))) return byte_form;
+    if (op == op_goto && fits_int16(displacement(op_goto16))) return op_goto16;
+    return op;
+}
+
+std::vector<missed_short_form> find_missed_short_forms(const JSFunctionBytecode * b, const control_flow_graph & cfg,
+                                                       const short_form_atoms & atoms) {
+    std::vector<missed_short_form> misses;
+
+    auto miss = [&](const uint32_t pos, const opcode long_op, const opcode short_op) {
+        const int saved = get_instruction(long_op).size - get_instruction(short_op).size;
+        if (saved > 0) misses.push_back({pos, long_op, short_op, static_cast<uint8_t>(saved)});
+    };
+
+    opcode previous_op = op_invalid;
+
+    for (uint32_t pos = 0; pos < static_cast<uint32_t>(b->byte_code_len);) {
+        const decoded_instruction insn = decode_instruction(b, pos);
+        const opcode op = insn.info->id;
+        const int64_t value = insn.operand_count > 0 ? insn.operands[0].value : 0;
+
+        switch (op) {
+            case op_push_i8:
+            case op_push_i16:
+            case op_push_i32:
+                miss(pos, op, short_int_form(value));
+                break;
+            case op_push_const:
+                if (value < 256) miss(pos, op, op_push_const8);
+                break;
+            case op_fclosure:
+                if (value < 256) miss(pos, op, op_fclosure8);
+                break;
+            case op_get_field:
+                if (static_cast<JSAtom>(value) == atoms.length) miss(pos, op, op_get_length);
+                break;
+            case op_push_atom_value:
+                if (static_cast<JSAtom>(value) == atoms.empty_string) miss(pos, op, op_push_empty_string);
+                break;
+            case op_if_false:
+            case op_if_true:
+            case op_goto:
+            case op_goto16:
+                miss(pos, op, short_jump_form(insn));
+                break;
+            case op_get_loc1:
+                // get_loc0 get_loc1 merge into get_loc0_loc1, unless a jump lands between them
+                if (previous_op == op_get_loc0 && cfg.blocks[cfg.block_at(pos)].start != pos) {
+                    misses.push_back({pos - 1, op_get_loc0, op_get_loc0_loc1, 1});
+                }
+                break;
+            default: {
+                const slot_forms forms = short_slot_forms(op);
+                if (forms.first == op_invalid) break;
+
+                if (value < 4) {
+                    miss(pos, op, offset_opcode(forms.first, value));
+                } else if (forms.byte_operand != op_invalid && value < 256) {
+                    miss(pos, op, forms.byte_operand);
+                }
+                break;
+            }
+        }
+
+        previous_op = op;
+        pos += insn.info->size;
+    }
+
+    return misses;
+}
+
+void short_form_totals::add_function(const JSFunctionBytecode * b, const std::vector<missed_short_form> & misses) {
+    functions++;
+    bytes += b->byte_code_len;
+    missed += misses.size();
+    for (const auto & miss : misses) saved += miss.saved;
+}
+
+short_form_totals & short_form_totals::operator+=(const short_form_totals & other) {
+    functions += other.functions;
+    bytes += other.bytes;
+    missed += other.missed;
+    saved += other.saved;
+    return *this;
+}
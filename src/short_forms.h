@@ -0,0 +1,43 @@
+#ifndef SHORT_FORMS_H
+#define SHORT_FORMS_H
+#include <cstdint>
+#include <vector>
+
+#include "control_flow.h"
+#include "opcodes.h"
+#include "quickjs_bytecode.h"
+
+// Atoms some compact forms depend on, as returned by JS_NewAtom for "length" and ""
+struct short_form_atoms {
+    JSAtom length;
+    JSAtom empty_string;
+};
+
+// An instruction encoded longer than a compact form the compiler could have used for it
+struct missed_short_form {
+    uint32_t pos;
+    opcode long_op;
+    opcode short_op;
+    // Bytes the compact form would save, counting a pair of instructions merged into one as a whole
+    uint8_t saved;
+};
+
+// Finds the instructions whose operands fit one of the compact forms that put_short_code, push_short_int
+// and the jump shrinking of resolve_labels in quickjs.c emit. Jump displacements are checked as they
+// would be with the jump itself shrunk, which moves forward targets closer.
+std::vector<missed_short_form> find_missed_short_forms(const JSFunctionBytecode * b, const control_flow_graph & cfg,
+                                                       const short_form_atoms & atoms);
+
+// Missed compact forms over a set of functions
+struct short_form_totals {
+    uint64_t functions = 0;
+    uint64_t bytes = 0;
+    uint64_t missed = 0;
+    uint64_t saved = 0;
+
+    void add_function(const JSFunctionBytecode * b, const std::vector<missed_short_form> & misses);
+
+    short_form_totals & operator+=(const short_form_totals & other);
+};
+
+#endif //SHORT_FORMS_H
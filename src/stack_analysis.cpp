@@ -0,0 +1,212 @@
+#include "stack_analysis.h"
+#include <format>
+
+#include "instruction_decoder.h"
+
+constexpr int UNKNOWN_DEPTH = -1;
+constexpr int NO_CATCH = -1;
+
+namespace {
+
+struct stack_walker {
+    const JSFunctionBytecode * b;
+    const control_flow_graph & cfg;
+    stack_analysis & result;
+
+    // Depth and innermost catch offset before each instruction which has been reached
+    std::vector<int> depth_at;
+    std::vector<int> catch_at;
+    std::vector<uint32_t> worklist;
+
+    void issue(const uint32_t pos, std::string message) {
+        result.issues.push_back({pos, std::move(message)});
+    }
+
+    void reach_depth(const int depth, const uint32_t pos) {
+        if (depth > result.max_depth) {
+            result.max_depth = depth;
+            result.max_depth_pos = pos;
+        }
+    }
+
+    // Enters the block starting at pos with the given state, queueing it the first time it is reached
+    void enter(const uint32_t from, const int64_t pos, const int depth, const int catch_pos) {
+        if (pos < 0 || pos >= b->byte_code_len) {
+            issue(from, std::format("jump to {} outside the bytecode", pos));
+            return;
+        }
+
+        reach_depth(depth, static_cast<uint32_t>(pos));
+
+        if (depth_at[pos] != UNKNOWN_DEPTH) {
+            if (depth_at[pos] != depth) {
+                issue(from, std::format("inconsistent stack depth at {}: {} and {}", pos, depth_at[pos], depth));
+            } else if (catch_at[pos] != catch_pos) {
+                issue(from, std::format("inconsistent catch position at {}: {} and {}", pos, catch_at[pos], catch_pos));
+            }
+            return;
+        }
+
+        depth_at[pos] = depth;
+        catch_at[pos] = catch_pos;
+        worklist.push_back(cfg.block_at(static_cast<uint32_t>(pos)));
+    }
+
+    // Level of the catch offset pushed at catch_pos. for_of_start and for_await_of_start
+    // keep it in the first of the entries they push rather than on top.
+    int catch_level(const int catch_pos) const {
+        const int level = depth_at[catch_pos];
+        return b->byte_code_buf[catch_pos] == op_catch ? level : level + 1;
+    }
+
+    void walk_block(const basic_block & block) {
+        int depth = depth_at[block.start];
+        int catch_pos = catch_at[block.start];
+
+        for (uint32_t pos = block.start; pos < block.end;) {
+            const decoded_instruction insn = decode_instruction(b, pos);
+            const instruction & info = *insn.info;
+            const uint32_t next = pos + info.size;
+
+            depth_at[pos] = depth;
+            catch_at[pos] = catch_pos;
+
+            if (info.id == op_invalid) {
+                issue(pos, "invalid opcode");
+                return;
+            }
+
+            int n_pop = info.n_pop;
+            // Calls pop a variable number of arguments
+            if (info.format == fmt_npop || info.format == fmt_npop_u16 || info.format == fmt_npopx) {
+                n_pop += static_cast<int>(insn.operands[0].value);
+            }
+
+            if (depth < n_pop) {
+                issue(pos, std::format("stack underflow: {} popped at depth {}", n_pop, depth));
+                return;
+            }
+
+            depth += info.n_push - n_pop;
+            reach_depth(depth, pos);
+
+            const int64_t target = label_target(insn);
+            int checked_level = -1;
+
+            switch (info.id) {
+                case op_tail_call:
+                case op_tail_call_method:
+                case op_return:
+                case op_return_undef:
+                case op_return_async:
+                case op_throw:
+                case op_throw_error:
+                case op_ret:
+                    return;
+                case op_goto:
+                case op_goto8:
+                case op_goto16:
+                    enter(pos, target, depth, catch_pos);
+                    return;
+                case op_if_true:
+                case op_if_false:
+                case op_if_true8:
+                case op_if_false8:
+                    enter(pos, target, depth, catch_pos);
+                    break;
+                case op_gosub:
+                    enter(pos, target, depth + 1, catch_pos);
+                    break;
+                case op_with_get_var:
+                case op_with_delete_var:
+                    enter(pos, target, depth + 1, catch_pos);
+                    break;
+                case op_with_make_ref:
+                case op_with_get_ref:
+                case op_with_get_ref_undef:
+                    enter(pos, target, depth + 2, catch_pos);
+                    break;
+                case op_with_put_var:
+                    enter(pos, target, depth - 1, catch_pos);
+                    break;
+                case op_catch:
+                    enter(pos, target, depth, catch_pos);
+                    catch_pos = static_cast<int>(pos);
+                    break;
+                case op_for_of_start:
+                case op_for_await_of_start:
+                    catch_pos = static_cast<int>(pos);
+                    break;
+                // The catch offset is assumed to only be removed by these instructions
+                case op_drop:
+                    checked_level = depth;
+                    break;
+                case op_nip:
+                case op_nip1:
+                    checked_level = depth - 1;
+                    break;
+                case op_iterator_close:
+                    checked_level = depth + 2;
+                    break;
+                case op_nip_catch:
+                    if (catch_pos == NO_CATCH) {
+                        issue(pos, "nip_catch without a catch");
+                        return;
+                    }
+                    depth = catch_level(catch_pos) + 1;
+                    catch_pos = catch_at[catch_pos];
+                    break;
+                default:
+                    break;
+            }
+
+            if (checked_level >= 0 && catch_pos != NO_CATCH && checked_level == catch_level(catch_pos)) {
+                catch_pos = catch_at[catch_pos];
+            }
+
+            // Execution continues in the next block, unless it ends the bytecode
+            if (next >= block.end && next < static_cast<uint32_t>(b->byte_code_len)) {
+                enter(pos, next, depth, catch_pos);
+            } else if (next >= static_cast<uint32_t>(b->byte_code_len)) {
+                issue(pos, "execution runs past the end of the bytecode");
+            }
+
+            pos = next;
+        }
+    }
+};
+
+}
+
+stack_analysis analyze_stack(const JSFunctionBytecode * b, const control_flow_graph & cfg) {
+    stack_analysis result{
+        .max_depth = 0,
+        .max_depth_pos = 0,
+        .issues = {},
+    };
+
+    if (b->byte_code_len <= 0) return result;
+
+    stack_walker walker{
+        .b = b,
+        .cfg = cfg,
+        .result = result,
+        .depth_at = std::vector<int>(b->byte_code_len, UNKNOWN_DEPTH),
+        .catch_at = std::vector<int>(b->byte_code_len, NO_CATCH),
+        .worklist = {},
+    };
+
+    walker.enter(0, 0, 0, NO_CATCH);
+
+    while (!walker.worklist.empty()) {
+        const uint32_t block = walker.worklist.back();
+        walker.worklist.pop_back();
+        walker.walk_block(cfg.blocks[block]);
+    }
+
+    return result;
+}
+
+uint32_t frame_size(const JSFunctionBytecode * b) {
+    return sizeof(JSValue) * (b->arg_count + b->var_count + b->stack_size);
+}
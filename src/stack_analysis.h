@@ -0,0 +1,31 @@
+#ifndef STACK_ANALYSIS_H
+#define STACK_ANALYSIS_H
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "control_flow.h"
+#include "quickjs_bytecode.h"
+
+struct stack_issue {
+    uint32_t pos;
+    std::string message;
+};
+
+struct stack_analysis {
+    // Largest stack depth reached, and the offset of the first instruction reaching it
+    int max_depth;
+    uint32_t max_depth_pos;
+    // Places where the bytecode breaks the rules compute_stack_size in quickjs.c enforces
+    std::vector<stack_issue> issues;
+};
+
+// Propagates the stack depth over the function's control-flow graph with the same rules as
+// compute_stack_size in quickjs.c, so max_depth is what the compiler stored in stack_size
+// unless the bytecode is inconsistent.
+stack_analysis analyze_stack(const JSFunctionBytecode * b, const control_flow_graph & cfg);
+
+// Bytes JS_CallInternal reserves on the C stack for a call of the function, when it has to copy the arguments
+uint32_t frame_size(const JSFunctionBytecode * b);
+
+#endif //STACK_ANALYSIS_H
@@ -1,5 +1,10 @@
 #include "utilities.h"
+#include <algorithm>
+#include <atomic>
 #include <sstream>
+#include <string_view>
+#include <thread>
+#include <vector>
 
 std::string read_ifstream(const std::ifstream * file) {
     std::stringstream stream;
@@ -7,3 +12,121 @@ std::string read_ifstream(const std::ifstream * file) {
     return stream.str();
 }
 
+void run_workers(const unsigned int num_threads, const std::function<void()> & worker) {
+    if (num_threads <= 1) {
+        worker();
+        return;
+    }
+
+    std::vector<std::thread> workers;
+    workers.reserve(num_threads);
+
+    for (unsigned int t = 0; t < num_threads; t++) {
+        workers.emplace_back(worker);
+    }
+
+    for (auto & thread : workers) {
+        thread.join();
+    }
+}
+
+void parallel_for(const size_t count, unsigned int num_threads, const std::function<void(size_t)> & fn) {
+    if (num_threads > count) num_threads = static_cast<unsigned int>(count);
+
+    std::atomic<size_t> next{0};
+
+    run_workers(num_threads, [&] {
+        for (size_t i = next++; i < count; i = next++) {
+            fn(i);
+        }
+    });
+}
+
+unsigned int default_thread_count() {
+    const unsigned int threads = std::thread::hardware_concurrency();
+    return threads == 0 ? 1 : threads;
+}
+
+std::string exception_to_string(JSContext * ctx, const JSValue exception) {
+    std::string result;
+
+    const char * str = JS_ToCString(ctx, exception);
+    result = str ? str : "[exception]";
+    JS_FreeCString(ctx, str);
+
+    if (JS_IsError(ctx, exception)) {
+        const JSValue stack = JS_GetPropertyStr(ctx, exception, "stack");
+        if (!JS_IsUndefined(stack)) {
+            const char * stack_str = JS_ToCString(ctx, stack);
+            if (stack_str) {
+                result += "\n";
+                result += stack_str;
+                while (result.ends_with('\n')) result.pop_back();
+            }
+            JS_FreeCString(ctx, stack_str);
+        }
+        JS_FreeValue(ctx, stack);
+    }
+
+    return result;
+}
+
+void capture_stack(JSContext * ctx, const JSValueConst error_constructor, const int max_depth,
+                   std::vector<std::string> & frames) {
+    // Capturing would replace an exception on its way to a handler
+    if (JS_HasException(ctx)) return;
+
+    const JSValue limit = JS_GetPropertyStr(ctx, error_constructor, "stackTraceLimit");
+    const JSValue prepare = JS_GetPropertyStr(ctx, error_constructor, "prepareStackTrace");
+    JS_SetPropertyStr(ctx, error_constructor, "stackTraceLimit", JS_NewInt32(ctx, max_depth));
+    if (!JS_IsUndefined(prepare)) {
+        JS_SetPropertyStr(ctx, error_constructor, "prepareStackTrace", JS_UNDEFINED);
+    }
+
+    const JSValue error = JS_NewError(ctx);
+    const JSValue stack = JS_IsException(error) ? JS_UNDEFINED : JS_GetPropertyStr(ctx, error, "stack");
+
+    JS_SetPropertyStr(ctx, error_constructor, "stackTraceLimit", limit);
+    if (!JS_IsUndefined(prepare)) {
+        JS_SetPropertyStr(ctx, error_constructor, "prepareStackTrace", prepare);
+    }
+
+    const char * text = JS_IsString(stack) ? JS_ToCString(ctx, stack) : nullptr;
+
+    if (text != nullptr) {
+        constexpr std::string_view prefix = "    at ";
+        constexpr std::string_view missing = " (missing)";
+        // The backtrace has one line per stack level, which JS_GetScriptOrModuleName counts the same way
+        int level = 0;
+
+        std::string_view rest = text;
+        while (!rest.empty()) {
+            const size_t end = std::min(rest.find('\n'), rest.size());
+            std::string_view frame = rest.substr(0, end);
+            rest.remove_prefix(std::min(end + 1, rest.size()));
+            if (frame.empty()) continue;
+
+            if (frame.starts_with(prefix)) frame.remove_prefix(prefix.size());
+
+            if (frame.ends_with(missing)) {
+                frame.remove_suffix(missing.size());
+                const JSAtom file_atom = JS_GetScriptOrModuleName(ctx, level);
+                const char * file = file_atom == JS_ATOM_NULL ? nullptr : JS_AtomToCString(ctx, file_atom);
+                frames.push_back(std::string(frame) + " (" + (file ? file : "<unknown>") + ")");
+                if (file != nullptr) JS_FreeCString(ctx, file);
+                JS_FreeAtom(ctx, file_atom);
+            } else {
+                frames.emplace_back(frame);
+            }
+            level++;
+        }
+
+        JS_FreeCString(ctx, text);
+    }
+
+    JS_FreeValue(ctx, stack);
+    JS_FreeValue(ctx, error);
+    if (JS_HasException(ctx)) {
+        JS_FreeValue(ctx, JS_GetException(ctx));
+    }
+}
@@ -1,8 +1,34 @@
 #ifndef UTILITIES_H
 #define UTILITIES_H
+#include <cstddef>
+#include <functional>
 #include <string>
+#include <vector>
 #include <fstream>
 
+#include "quickjs.h"
+
 std::string read_ifstream(const std::ifstream * file);
 
+// Runs worker() on num_threads threads and waits for all of them to return.
+// Workers which keep per-thread state (such as a JSRuntime) pull their own work items.
+void run_workers(unsigned int num_threads, const std::function<void()> & worker);
+
+// Calls fn(0) .. fn(count - 1) spread over num_threads worker threads.
+// Indices are handed out dynamically, so uneven work items still balance.
+void parallel_for(size_t count, unsigned int num_threads, const std::function<void(size_t)> & fn);
+
+// Number of worker threads to use when the user did not ask for a specific amount
+unsigned int default_thread_count();
+
+// Message and stack trace of a thrown value
+std::string exception_to_string(JSContext * ctx, JSValue exception);
+
+// Appends the frames of the current JS stack, innermost first, as "name (file:line:col)" lines taken from the
+// backtrace the engine builds for a new Error. Frames which have not made a call yet have no position and are
+// given as "name (file)". error_constructor is the context's Error, whose stackTraceLimit is set to max_depth and
+// prepareStackTrace set aside while the backtrace is built. Getting and setting them calls their accessors,
+// which polls for interrupts. Nothing is captured while an exception is pending.
+void capture_stack(JSContext * ctx, JSValueConst error_constructor, int max_depth, std::vector<std::string> & frames);
+
 #endif //UTILITIES_H